@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bitmap.h"
+
+Bitmap *AllocateBitmap( unsigned int width , unsigned int height )
+{
+	Bitmap *bitmap = malloc( sizeof(Bitmap) );
+	if( !bitmap ) return NULL;
+
+	bitmap->width = width;
+	bitmap->height = height;
+	bitmap->wordsPerRow = ( width+63 )/64;
+
+	// calloc clears all the bits, including the padding past the width
+	bitmap->words = calloc( (size_t)bitmap->wordsPerRow * height + 1 , sizeof(uint64_t) );
+	if( !bitmap->words )
+	{
+		free( bitmap );
+		return NULL;
+	}
+	return bitmap;
+}
+
+void FreeBitmap( Bitmap **bitmap )
+{
+	free( (*bitmap)->words );
+	free( *bitmap );
+	*bitmap = NULL;
+}
+
+bool IsBitSet( const Bitmap *bitmap , PixelIndex idx )
+{
+	if( idx.x>=bitmap->width || idx.y>=bitmap->height ) return false;
+	return ( bitmap->words[ idx.y*bitmap->wordsPerRow + idx.x/64 ]>>( idx.x%64 ) ) & 1;
+}
+
+void SetBit( Bitmap *bitmap , PixelIndex idx )
+{
+	bitmap->words[ idx.y*bitmap->wordsPerRow + idx.x/64 ] |= (uint64_t)1<<( idx.x%64 );
+}
+
+// population count using parallel bit sums
+unsigned int CountBits( uint64_t word )
+{
+	word = word - ( ( word>>1 ) & 0x5555555555555555ULL );
+	word = ( word & 0x3333333333333333ULL ) + ( ( word>>2 ) & 0x3333333333333333ULL );
+	word = ( word + ( word>>4 ) ) & 0x0F0F0F0F0F0F0F0FULL;
+	return (unsigned int)( ( word * 0x0101010101010101ULL )>>56 );
+}
+
+unsigned int CountRowBits( const Bitmap *bitmap , unsigned int row )
+{
+	unsigned int count = 0;
+	const uint64_t *words = bitmap->words + row*bitmap->wordsPerRow;
+	for( unsigned int w=0 ; w<bitmap->wordsPerRow ; w++ ) count += CountBits( words[w] );
+	return count;
+}
+
+// The eight neighbor masks of a word are built by shifting the words of the row above,
+// the row itself and the row below by one pixel in each direction (carrying the bit over
+// from the adjacent word), and are then added together bit-sliced with a 4-bit ripple
+// counter. Since every row starts on a new word and the bits past the width are zero,
+// pixels on the left and right edges never see pixels from the neighboring rows.
+void CountNeighborBits( const Bitmap *bitmap , unsigned int row , unsigned int word , uint64_t planes[4] )
+{
+	uint64_t neighbors[8];
+	int numNeighbors = 0;
+
+	for( int dy=-1 ; dy<=1 ; dy++ )
+	{
+		int y = (int)row + dy;
+		if( y<0 || y>=(int)bitmap->height ) continue;
+
+		const uint64_t *words = bitmap->words + y*bitmap->wordsPerRow;
+		uint64_t cur = words[word];
+		uint64_t prev = word>0 ? words[word-1] : 0;
+		uint64_t next = word+1<bitmap->wordsPerRow ? words[word+1] : 0;
+
+		neighbors[numNeighbors++] = ( cur<<1 ) | ( prev>>63 ); // pixel to the left
+		neighbors[numNeighbors++] = ( cur>>1 ) | ( next<<63 ); // pixel to the right
+		if( dy!=0 ) neighbors[numNeighbors++] = cur;            // pixel above or below
+	}
+
+	planes[0] = planes[1] = planes[2] = planes[3] = 0;
+	for( int n=0 ; n<numNeighbors ; n++ )
+	{
+		uint64_t carry = neighbors[n];
+		for( int k=0 ; k<4 && carry ; k++ )
+		{
+			uint64_t nextCarry = planes[k] & carry;
+			planes[k] ^= carry;
+			carry = nextCarry;
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef BITMAP_H_INCLUDED
+#define BITMAP_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "image.h"
+
+/** A struct storing one bit per pixel of an image (e.g. whether the pixel is set)*/
+typedef struct
+{
+	/** The width of the bitmap*/
+	unsigned int width;
+
+	/** The height of the bitmap*/
+	unsigned int height;
+
+	/** The number of words used for each row (bits past the width are always zero)*/
+	unsigned int wordsPerRow;
+
+	/** The bits, 64 pixels per word with the leftmost pixel in the least significant bit, each row starting on a new word*/
+	uint64_t *words;
+} Bitmap;
+
+/** A function returning a new bitmap with prescribed width and height and all bits cleared -- both the words and the bitmap itself are dynamically allocated (the function returns NULL if it failed to allocate them)*/
+Bitmap *AllocateBitmap( unsigned int width , unsigned int height );
+
+/** A function deallocating the memory associated to a bitmap and setting the pointer to NULL*/
+void FreeBitmap( Bitmap **bitmap );
+
+/** A function that returns the bit of the pixel described by the index (false if the index is out of bounds)*/
+bool IsBitSet( const Bitmap *bitmap , PixelIndex idx );
+
+/** A function that sets the bit of the pixel described by the index*/
+void SetBit( Bitmap *bitmap , PixelIndex idx );
+
+/** A function that returns the number of bits set in a word*/
+unsigned int CountBits( uint64_t word );
+
+/** A function that returns the number of bits set in a row of the bitmap*/
+unsigned int CountRowBits( const Bitmap *bitmap , unsigned int row );
+
+/** A function that counts, for each of the 64 pixels of a word of a row, how many of its eight neighbors have their bit set -- the counts are returned bit-sliced, i.e. bit i of planes[k] is bit k of the count of the i-th pixel*/
+void CountNeighborBits( const Bitmap *bitmap , unsigned int row , unsigned int word , uint64_t planes[4] );
+
+#endif // BITMAP_H_INCLUDED
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checkpoint.h"
+#include "image.h"
+
+// Layout of a checkpoint file (all integers little-endian):
+//   "TSCK" , version (u32)
+//   synWidth , synHeight , exWidth , exHeight , windowRadius (u32 each)
+//   (version 3 and up) batchSize , candidateBudget , seedGrid , palette (u32 each)
+//   (version 4 and up) the number of color channels of the image, 1 or 3 (u32)
+//   random number generator state (u64)
+//   r,g,b for every pixel, row by row (only r for single-channel images)
+//   the set flags, packed eight pixels per byte (least significant bit first)
+//   (version 2 and up) the exemplar source of every pixel as y*exWidth+x (u32), or 0xFFFFFFFF if unknown
+// The frontier is not stored since it is fully determined by the set flags.
+static const char CHECKPOINT_MAGIC[4] = { 'T' , 'S' , 'C' , 'K' };
+static const unsigned int CHECKPOINT_VERSION = 4;
+static const unsigned long long CHECKPOINT_UNKNOWN_SOURCE = 0xFFFFFFFFULL;
+
+// helper function that writes an unsigned integer of nBytes bytes in little-endian order
+static int checkpoint_write_uint( FILE *fp , unsigned long long value , int nBytes )
+{
+	unsigned char bytes[8];
+	for( int i=0 ; i<nBytes ; i++ ) bytes[i] = (unsigned char)( value>>(8*i) );
+	return fwrite( bytes , 1 , nBytes , fp )==(size_t)nBytes ? 0 : -1;
+}
+
+// helper function that reads an unsigned integer of nBytes bytes in little-endian order
+static int checkpoint_read_uint( FILE *fp , unsigned long long *value , int nBytes )
+{
+	unsigned char bytes[8];
+	if( fread( bytes , 1 , nBytes , fp )!=(size_t)nBytes ) return -1;
+	*value = 0;
+	for( int i=0 ; i<nBytes ; i++ ) *value |= ( (unsigned long long)bytes[i] )<<(8*i);
+	return 0;
+}
+
+int WriteCheckpoint( const char *path , const Image *synthesized , const Bitmap *set , const PixelIndex *sources , const CheckpointHeader *header )
+{
+	// write to a temporary file first so that the previous checkpoint survives a crash mid-write
+	size_t pathLength = strlen( path );
+	char *tmpPath = malloc( pathLength + 5 );
+	if( !tmpPath )
+	{
+		fprintf( stderr , "[ERROR] WriteCheckpoint: Failed to allocate file name\n" );
+		return -1;
+	}
+	strcpy( tmpPath , path );
+	strcpy( tmpPath + pathLength , ".tmp" );
+
+	FILE *fp = fopen( tmpPath , "wb" );
+	if( !fp )
+	{
+		fprintf( stderr , "[ERROR] WriteCheckpoint: Failed to open file: %s\n" , tmpPath );
+		free( tmpPath );
+		return -1;
+	}
+
+	unsigned int numPixels = synthesized->width * synthesized->height;
+	int failed = fwrite( CHECKPOINT_MAGIC , 1 , 4 , fp )!=4;
+	failed |= checkpoint_write_uint( fp , CHECKPOINT_VERSION , 4 );
+	failed |= checkpoint_write_uint( fp , synthesized->width , 4 );
+	failed |= checkpoint_write_uint( fp , synthesized->height , 4 );
+	failed |= checkpoint_write_uint( fp , header->exWidth , 4 );
+	failed |= checkpoint_write_uint( fp , header->exHeight , 4 );
+	failed |= checkpoint_write_uint( fp , header->windowRadius , 4 );
+	failed |= checkpoint_write_uint( fp , header->batchSize , 4 );
+	failed |= checkpoint_write_uint( fp , header->candidateBudget , 4 );
+	failed |= checkpoint_write_uint( fp , header->seedGrid , 4 );
+	failed |= checkpoint_write_uint( fp , header->palette , 4 );
+	failed |= checkpoint_write_uint( fp , synthesized->channels==1 ? 1 : 3 , 4 );
+	failed |= checkpoint_write_uint( fp , header->randState , 8 );
+
+	// colors
+	for( unsigned int i=0 ; i<numPixels && !failed ; i++ )
+	{
+		if( synthesized->channels==1 ) failed |= fputc( synthesized->pixels[i].r , fp )==EOF;
+		else failed |= fwrite( synthesized->pixels+i , sizeof(unsigned char) , 3 , fp )!=3;
+	}
+
+	// set flags, packed into bits
+	for( unsigned int i=0 ; i<numPixels && !failed ; i+=8 )
+	{
+		unsigned char bits = 0;
+		for( unsigned int j=0 ; j<8 && i+j<numPixels ; j++ )
+		{
+			PixelIndex idx = { ( i+j )%synthesized->width , ( i+j )/synthesized->width };
+			if( IsBitSet( set , idx ) ) bits |= (unsigned char)( 1<<j );
+		}
+		failed |= fputc( bits , fp )==EOF;
+	}
+
+	// sources
+	for( unsigned int i=0 ; i<numPixels && !failed ; i++ )
+	{
+		unsigned long long source = CHECKPOINT_UNKNOWN_SOURCE;
+		if( sources[i].x!=INVALID_PIXEL_COORD ) source = (unsigned long long)sources[i].y * header->exWidth + sources[i].x;
+		failed |= checkpoint_write_uint( fp , source , 4 );
+	}
+
+	failed |= fclose( fp )!=0;
+	if( failed || rename( tmpPath , path ) )
+	{
+		fprintf( stderr , "[ERROR] WriteCheckpoint: Failed to write checkpoint: %s\n" , path );
+		remove( tmpPath );
+		free( tmpPath );
+		return -1;
+	}
+
+	free( tmpPath );
+	return 0;
+}
+
+int ReadCheckpointDimensions( const char *path , unsigned int *width , unsigned int *height )
+{
+	FILE *fp = fopen( path , "rb" );
+	if( !fp )
+	{
+		fprintf( stderr , "[ERROR] ReadCheckpointDimensions: Failed to open file: %s\n" , path );
+		return -1;
+	}
+
+	char magic[4];
+	unsigned long long version , w , h;
+	int failed = fread( magic , 1 , 4 , fp )!=4 || memcmp( magic , CHECKPOINT_MAGIC , 4 ) ||
+		checkpoint_read_uint( fp , &version , 4 ) || version<1 || version>CHECKPOINT_VERSION ||
+		checkpoint_read_uint( fp , &w , 4 ) || checkpoint_read_uint( fp , &h , 4 );
+	fclose( fp );
+	if( failed )
+	{
+		fprintf( stderr , "[ERROR] ReadCheckpointDimensions: Not a checkpoint: %s\n" , path );
+		return -1;
+	}
+	*width = (unsigned int)w;
+	*height = (unsigned int)h;
+	return 0;
+}
+
+Image *ReadCheckpoint( const char *path , CheckpointHeader *header , Bitmap **set , PixelIndex **sources )
+{
+	FILE *fp = fopen( path , "rb" );
+	if( !fp )
+	{
+		fprintf( stderr , "[ERROR] ReadCheckpoint: Failed to open file: %s\n" , path );
+		return NULL;
+	}
+
+	char magic[4];
+	unsigned long long version , width , height , exWidth , exHeight , windowRadius , randState;
+	unsigned long long batchSize = 1 , candidateBudget = 0 , seedGrid = 1 , palette = 0 , channels = 3;
+	if( fread( magic , 1 , 4 , fp )!=4 || memcmp( magic , CHECKPOINT_MAGIC , 4 ) ||
+		checkpoint_read_uint( fp , &version , 4 ) || version<1 || version>CHECKPOINT_VERSION )
+	{
+		fprintf( stderr , "[ERROR] ReadCheckpoint: Not a checkpoint (bad tag or version): %s\n" , path );
+		fclose( fp );
+		return NULL;
+	}
+	if( checkpoint_read_uint( fp , &width , 4 ) || checkpoint_read_uint( fp , &height , 4 ) ||
+		checkpoint_read_uint( fp , &exWidth , 4 ) || checkpoint_read_uint( fp , &exHeight , 4 ) ||
+		checkpoint_read_uint( fp , &windowRadius , 4 ) ||
+		( version>=3 && ( checkpoint_read_uint( fp , &batchSize , 4 ) || checkpoint_read_uint( fp , &candidateBudget , 4 ) ||
+						  checkpoint_read_uint( fp , &seedGrid , 4 ) || checkpoint_read_uint( fp , &palette , 4 ) ) ) ||
+		( version>=4 && checkpoint_read_uint( fp , &channels , 4 ) ) || ( channels!=1 && channels!=3 ) ||
+		checkpoint_read_uint( fp , &randState , 8 ) ||
+		width==0 || height==0 )
+	{
+		fprintf( stderr , "[ERROR] ReadCheckpoint: Failed to read header: %s\n" , path );
+		fclose( fp );
+		return NULL;
+	}
+
+	Image *img = AllocateImage( (unsigned int)width , (unsigned int)height );
+	*set = AllocateBitmap( (unsigned int)width , (unsigned int)height );
+	*sources = malloc( sizeof(PixelIndex) * width * height );
+	if( !img || !img->pixels || !*set || !*sources )
+	{
+		fprintf( stderr , "[ERROR] ReadCheckpoint: Failed to allocate image: %llu x %llu\n" , width , height );
+		if( img ) FreeImage( &img );
+		if( *set ) FreeBitmap( set );
+		free( *sources );
+		fclose( fp );
+		return NULL;
+	}
+
+	img->channels = (unsigned int)channels;
+	unsigned int numPixels = img->width * img->height;
+	for( unsigned int i=0 ; i<numPixels ; i++ )
+	{
+		if( fread( img->pixels+i , sizeof(unsigned char) , channels , fp )!=channels )
+		{
+			fprintf( stderr , "[ERROR] ReadCheckpoint: Failed to read pixel from file: %d / %d\n" , i , numPixels );
+			FreeImage( &img );
+			FreeBitmap( set );
+			free( *sources );
+			fclose( fp );
+			return NULL;
+		}
+		if( channels==1 ) img->pixels[i].g = img->pixels[i].b = img->pixels[i].r;
+		img->pixels[i].a = 255;
+	}
+	for( unsigned int i=0 ; i<numPixels ; i+=8 )
+	{
+		int bits = fgetc( fp );
+		if( bits==EOF )
+		{
+			fprintf( stderr , "[ERROR] ReadCheckpoint: Failed to read set flags from file: %s\n" , path );
+			FreeImage( &img );
+			FreeBitmap( set );
+			free( *sources );
+			fclose( fp );
+			return NULL;
+		}
+		for( unsigned int j=0 ; j<8 && i+j<numPixels ; j++ )
+		{
+			PixelIndex idx = { ( i+j )%img->width , ( i+j )/img->width };
+			if( ( bits>>j ) & 1 ) SetBit( *set , idx );
+		}
+	}
+	for( unsigned int i=0 ; i<numPixels ; i++ )
+	{
+		unsigned long long source = CHECKPOINT_UNKNOWN_SOURCE;
+		if( version>=2 && checkpoint_read_uint( fp , &source , 4 ) )
+		{
+			fprintf( stderr , "[ERROR] ReadCheckpoint: Failed to read sources from file: %s\n" , path );
+			FreeImage( &img );
+			FreeBitmap( set );
+			free( *sources );
+			fclose( fp );
+			return NULL;
+		}
+		if( source==CHECKPOINT_UNKNOWN_SOURCE || exWidth==0 )
+		{
+			(*sources)[i].x = (*sources)[i].y = INVALID_PIXEL_COORD;
+		}
+		else
+		{
+			(*sources)[i].x = (unsigned int)( source % exWidth );
+			(*sources)[i].y = (unsigned int)( source / exWidth );
+		}
+	}
+	fclose( fp );
+
+	header->exWidth = (unsigned int)exWidth;
+	header->exHeight = (unsigned int)exHeight;
+	header->windowRadius = (unsigned int)windowRadius;
+	header->batchSize = (unsigned int)batchSize;
+	header->candidateBudget = (unsigned int)candidateBudget;
+	header->seedGrid = (unsigned int)seedGrid;
+	header->palette = (unsigned int)palette;
+	header->randState = randState;
+	return img;
+}
@@ -0,0 +1,39 @@
+#ifndef CHECKPOINT_H_INCLUDED
+#define CHECKPOINT_H_INCLUDED
+
+#include "image.h"
+#include "bitmap.h"
+
+/** A struct storing the synthesis parameters saved alongside the partial image in a checkpoint*/
+typedef struct
+{
+	/** The width of the exemplar the synthesis was started from*/
+	unsigned int exWidth;
+
+	/** The height of the exemplar the synthesis was started from*/
+	unsigned int exHeight;
+
+	/** The window radius used by the synthesis*/
+	unsigned int windowRadius;
+
+	/** The synthesis options that change the output: the batch size, the candidate budget, the seed grid size and whether the exemplar is palette-quantized (0 or 1)*/
+	unsigned int batchSize;
+	unsigned int candidateBudget;
+	unsigned int seedGrid;
+	unsigned int palette;
+
+	/** The state of the synthesis random number generator when the checkpoint was taken*/
+	unsigned long long randState;
+
+} CheckpointHeader;
+
+/** A function that writes the partial image (colors, bitmap of set pixels and, for each pixel, the exemplar pixel it was copied from) and the header to a binary checkpoint file, storing one byte per pixel for single-channel images and three otherwise -- the file is written under a temporary name and renamed, so an interrupted write never clobbers the previous checkpoint (returns -1 if any failure occurs, otherwise 0)*/
+int WriteCheckpoint( const char *path , const Image *synthesized , const Bitmap *set , const PixelIndex *sources , const CheckpointHeader *header );
+
+/** A function that reads only the dimensions of the image stored in a checkpoint file (returns -1 if the file cannot be read or is not a checkpoint, otherwise 0)*/
+int ReadCheckpointDimensions( const char *path , unsigned int *width , unsigned int *height );
+
+/** A function that reads a checkpoint file written by WriteCheckpoint, filling in the header and allocating the bitmap of set pixels and the array of sources (sources are INVALID_PIXEL_COORD and the options are the defaults for files written before they were stored; returns NULL if the file cannot be read or is not a valid checkpoint)*/
+Image *ReadCheckpoint( const char *path , CheckpointHeader *header , Bitmap **set , PixelIndex **sources );
+
+#endif // CHECKPOINT_H_INCLUDED
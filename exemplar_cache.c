@@ -0,0 +1,121 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "exemplar_cache.h"
+#include "ppm.h"
+
+// frees the data of an entry (but not the entry itself)
+static void exemplar_cache_clear_entry( ExemplarCacheEntry *entry )
+{
+	free( entry->path );
+	FreeImage( &entry->exemplar );
+	FreePackedExemplar( &entry->packed );
+	if( entry->palettePacked ) FreePackedExemplar( &entry->palettePacked );
+}
+
+// builds the palette packing of an entry if it is requested and missing (returns false if it cannot be built)
+static bool exemplar_cache_prepare_palette( ExemplarCacheEntry *entry , bool palette , bool *hit )
+{
+	if( !palette || entry->palettePacked ) return true;
+	*hit = false;
+	entry->palettePacked = PackExemplarWithPalette( entry->exemplar );
+	return entry->palettePacked!=NULL;
+}
+
+ExemplarCache *AllocateExemplarCache( unsigned int capacity )
+{
+	if( capacity==0 ) return NULL;
+
+	ExemplarCache *cache = malloc( sizeof(ExemplarCache) );
+	if( !cache ) return NULL;
+	cache->entries = malloc( sizeof(ExemplarCacheEntry) * capacity );
+	if( !cache->entries )
+	{
+		free( cache );
+		return NULL;
+	}
+	cache->capacity = capacity;
+	cache->numEntries = 0;
+	cache->clock = 0;
+	return cache;
+}
+
+void FreeExemplarCache( ExemplarCache **cache )
+{
+	for( unsigned int i=0 ; i<(*cache)->numEntries ; i++ ) exemplar_cache_clear_entry( (*cache)->entries+i );
+	free( (*cache)->entries );
+	free( *cache );
+	*cache = NULL;
+}
+
+const ExemplarCacheEntry *GetCachedExemplar( ExemplarCache *cache , const char *path , bool palette , bool *hit )
+{
+	*hit = false;
+	cache->clock++;
+
+	struct stat st;
+	if( stat( path , &st ) )
+	{
+		fprintf( stderr , "[ERROR] GetCachedExemplar: Failed to stat file: %s\n" , path );
+		return NULL;
+	}
+
+	// look for the file; an entry for a file that has changed since it was read is dropped
+	for( unsigned int i=0 ; i<cache->numEntries ; i++ )
+	{
+		ExemplarCacheEntry *entry = cache->entries+i;
+		if( strcmp( entry->path , path ) ) continue;
+		if( entry->mtime==st.st_mtime && entry->size==(long long)st.st_size )
+		{
+			entry->lastUsed = cache->clock;
+			*hit = true;
+			return exemplar_cache_prepare_palette( entry , palette , hit ) ? entry : NULL;
+		}
+		exemplar_cache_clear_entry( entry );
+		cache->entries[i] = cache->entries[ --cache->numEntries ];
+		break;
+	}
+
+	// read and preprocess the exemplar
+	FILE *fp = fopen( path , "rb" );
+	if( !fp )
+	{
+		fprintf( stderr , "[ERROR] GetCachedExemplar: Failed to open file: %s\n" , path );
+		return NULL;
+	}
+	Image *exemplar = ReadPPM( fp );
+	fclose( fp );
+	if( !exemplar ) return NULL;
+	PackedExemplar *packed = PackExemplar( exemplar );
+	char *pathCopy = malloc( strlen( path )+1 );
+	if( !packed || !pathCopy )
+	{
+		fprintf( stderr , "[ERROR] GetCachedExemplar: Failed to allocate entry: %s\n" , path );
+		FreeImage( &exemplar );
+		if( packed ) FreePackedExemplar( &packed );
+		free( pathCopy );
+		return NULL;
+	}
+	strcpy( pathCopy , path );
+
+	// evict the least recently used entry if the cache is full
+	if( cache->numEntries==cache->capacity )
+	{
+		unsigned int lru = 0;
+		for( unsigned int i=1 ; i<cache->numEntries ; i++ ) if( cache->entries[i].lastUsed<cache->entries[lru].lastUsed ) lru = i;
+		exemplar_cache_clear_entry( cache->entries+lru );
+		cache->entries[lru] = cache->entries[ --cache->numEntries ];
+	}
+
+	ExemplarCacheEntry *entry = cache->entries + cache->numEntries++;
+	entry->path = pathCopy;
+	entry->mtime = st.st_mtime;
+	entry->size = (long long)st.st_size;
+	entry->exemplar = exemplar;
+	entry->packed = packed;
+	entry->palettePacked = NULL;
+	entry->lastUsed = cache->clock;
+	return exemplar_cache_prepare_palette( entry , palette , hit ) ? entry : NULL;
+}
@@ -0,0 +1,57 @@
+#ifndef EXEMPLAR_CACHE_H_INCLUDED
+#define EXEMPLAR_CACHE_H_INCLUDED
+
+#include <stdbool.h>
+#include <time.h>
+#include "image.h"
+#include "texture_synthesis.h"
+
+/** A struct storing an exemplar read from a file together with its preprocessed data*/
+typedef struct
+{
+	/** The name of the file the exemplar was read from*/
+	char *path;
+
+	/** The modification time and size of the file when it was read (used to detect changes)*/
+	time_t mtime;
+	long long size;
+
+	/** The exemplar image*/
+	Image *exemplar;
+
+	/** The exemplar packed for matching*/
+	PackedExemplar *packed;
+
+	/** The exemplar packed as palette indices (or NULL until a palette synthesis asks for it)*/
+	PackedExemplar *palettePacked;
+
+	/** The value of the cache's clock when the entry was last used*/
+	unsigned long lastUsed;
+} ExemplarCacheEntry;
+
+/** A struct storing a least-recently-used cache of exemplars*/
+typedef struct
+{
+	/** The maximum number of exemplars kept*/
+	unsigned int capacity;
+
+	/** The number of exemplars currently kept*/
+	unsigned int numEntries;
+
+	/** A counter incremented on every lookup, used to order the entries by last use*/
+	unsigned long clock;
+
+	/** The entries*/
+	ExemplarCacheEntry *entries;
+} ExemplarCache;
+
+/** A function returning a new, empty cache holding up to capacity exemplars (returns NULL if it failed to allocate the cache)*/
+ExemplarCache *AllocateExemplarCache( unsigned int capacity );
+
+/** A function deallocating a cache and all its exemplars and setting the pointer to NULL*/
+void FreeExemplarCache( ExemplarCache **cache );
+
+/** A function returning the cache entry of the exemplar stored in the given file, reading and preprocessing the file (and evicting the least recently used entry if the cache is full) if it is not cached or has changed since it was cached, and building its palette packing if palette is true and it has none yet -- hit is set to whether nothing had to be read or preprocessed (returns NULL if the file cannot be read or preprocessed)*/
+const ExemplarCacheEntry *GetCachedExemplar( ExemplarCache *cache , const char *path , bool palette , bool *hit );
+
+#endif // EXEMPLAR_CACHE_H_INCLUDED
@@ -3,9 +3,9 @@
 #include <stdlib.h>
 #include "image.h"
 
-double PixelSquaredDifference( Pixel p1 , Pixel p2 )
+unsigned int PixelSquaredDifference( Pixel p1 , Pixel p2 )
 {
-	double d2 = 0;
+	unsigned int d2 = 0;
 	d2 += ((int)p1.r-(int)p2.r) * ((int)p1.r-(int)p2.r);
 	d2 += ((int)p1.g-(int)p2.g) * ((int)p1.g-(int)p2.g);
 	d2 += ((int)p1.b-(int)p2.b) * ((int)p1.b-(int)p2.b);
@@ -51,6 +51,7 @@ Image *AllocateImage( unsigned int width , unsigned int height )
 	// Assign width and height
 	img->height = height;
 	img->width = width;
+	img->channels = 3;
 
 	// Dynamically allocate memory for pixels
 	img->pixels = malloc(sizeof(Pixel) * width * height);
@@ -2,6 +2,7 @@
 #define IMAGE_INCLUDED
 
 #include <stdbool.h>
+#include <limits.h>
 
 /** A struct for storing pixel information*/
 typedef struct
@@ -27,6 +28,9 @@ typedef struct
 	
 	/** The height of the image*/
 	unsigned int height;
+
+	/** The number of meaningful color channels (1 if the image is grayscale, in which case r==g==b, and 3 otherwise)*/
+	unsigned int channels;
 	
 	/** The pixels in the image, laid out row-by-row and, within each row, column-by-column*/
 	Pixel *pixels;
@@ -42,8 +46,11 @@ typedef struct
 	unsigned int y;
 } PixelIndex;
 
+/** The x coordinate of a PixelIndex that does not refer to any pixel*/
+#define INVALID_PIXEL_COORD UINT_MAX
+
 /** A function that returns the sum-of-squared differences of the pixels' red, green, and blue color values (the alpha values are not used)*/
-double PixelSquaredDifference( Pixel p1 , Pixel p2 );
+unsigned int PixelSquaredDifference( Pixel p1 , Pixel p2 );
 
 /** A function that checks that a pixel index is within the bounds of the image*/
 bool InBounds( const Image *image , PixelIndex idx );
@@ -56,7 +63,7 @@ Pixel *GetPixel( Image *image , PixelIndex idx );
 const Pixel *GetConstPixel( const Image *image , PixelIndex idx );
 
 
-/** A function returning a new image object with prescribed width and height -- both the pixels member of the image and the image itself are dynamically allocated (the function returns NULL if it failed to allocate the image or its pixels)*/
+/** A function returning a new three-channel image object with prescribed width and height -- both the pixels member of the image and the image itself are dynamically allocated (the function returns NULL if it failed to allocate the image or its pixels)*/
 Image *AllocateImage( unsigned int width , unsigned int height );
 
 /** A function deallocating the memory associated to an image and sets the pointer to the image to NULL (this deallocates both the pixels member of the image and the image itself*/
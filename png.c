@@ -0,0 +1,281 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "png.h"
+#include "image.h"
+
+// size of the buffer the compressed stream is collected in before it is written out as an IDAT chunk
+#define PNG_IDAT_BUFFER_SIZE (1<<16)
+
+struct PNGWriter
+{
+	// output file and image layout
+	FILE *fp;
+	unsigned int width;
+	unsigned int height;
+	unsigned int channels;
+
+	// encoder thread and the state shared with it (guarded by lock)
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t rowsChanged;
+	const Image *img;
+	unsigned int rowsReady;
+	bool closing;
+
+	// state owned by the encoder thread
+	unsigned int rowsWritten;
+	bool failed;
+	z_stream stream;
+	unsigned char *rawRows[2];
+	unsigned char *filteredRows[5];
+	unsigned char *idatBuffer;
+};
+
+// writes a 32-bit big-endian integer to a byte buffer
+static void png_put_uint( unsigned char *bytes , unsigned long value )
+{
+	bytes[0] = (unsigned char)( value>>24 );
+	bytes[1] = (unsigned char)( value>>16 );
+	bytes[2] = (unsigned char)( value>>8 );
+	bytes[3] = (unsigned char)( value );
+}
+
+// writes a chunk (length, type, data and CRC) to the file, returning -1 on failure
+static int png_write_chunk( FILE *fp , const char *type , const unsigned char *data , unsigned int length )
+{
+	unsigned char bytes[4];
+	unsigned long crc = crc32( 0L , (const Bytef *)type , 4 );
+	if( length ) crc = crc32( crc , data , length );
+
+	png_put_uint( bytes , length );
+	if( fwrite( bytes , 1 , 4 , fp )!=4 || fwrite( type , 1 , 4 , fp )!=4 ) return -1;
+	if( length && fwrite( data , 1 , length , fp )!=length ) return -1;
+	png_put_uint( bytes , crc );
+	if( fwrite( bytes , 1 , 4 , fp )!=4 ) return -1;
+	return 0;
+}
+
+// the Paeth predictor from the PNG specification
+static unsigned char png_paeth( int a , int b , int c )
+{
+	int p = a + b - c;
+	int pa = abs( p - a ) , pb = abs( p - b ) , pc = abs( p - c );
+	if( pa<=pb && pa<=pc ) return (unsigned char)a;
+	if( pb<=pc ) return (unsigned char)b;
+	return (unsigned char)c;
+}
+
+// filters a row with each of the five PNG filters and returns the one with the
+// smallest sum of absolute residuals (the heuristic recommended by the specification)
+static const unsigned char *png_filter_row( PNGWriter *writer , const unsigned char *row , const unsigned char *prev )
+{
+	unsigned int bpp = writer->channels;
+	unsigned int length = writer->width * bpp;
+	const unsigned char *best = NULL;
+	unsigned long bestSum = 0;
+
+	for( int f=0 ; f<5 ; f++ )
+	{
+		unsigned char *out = writer->filteredRows[f];
+		unsigned long sum = 0;
+		out[0] = (unsigned char)f;
+		for( unsigned int i=0 ; i<length ; i++ )
+		{
+			int a = i>=bpp ? row[i-bpp] : 0;
+			int b = prev ? prev[i] : 0;
+			int c = ( prev && i>=bpp ) ? prev[i-bpp] : 0;
+			unsigned char predicted = 0;
+			switch( f )
+			{
+				case 1: predicted = (unsigned char)a ; break;
+				case 2: predicted = (unsigned char)b ; break;
+				case 3: predicted = (unsigned char)( ( a + b )/2 ) ; break;
+				case 4: predicted = png_paeth( a , b , c ) ; break;
+			}
+			out[i+1] = (unsigned char)( row[i] - predicted );
+			sum += out[i+1]<128 ? out[i+1] : 256 - out[i+1];
+		}
+		if( !best || sum<bestSum )
+		{
+			best = out;
+			bestSum = sum;
+		}
+	}
+	return best;
+}
+
+// runs the compressor on the given input, writing an IDAT chunk whenever the output buffer
+// fills up (and, when finishing, once the stream is complete)
+static void png_deflate( PNGWriter *writer , const unsigned char *data , unsigned int length , int flush )
+{
+	writer->stream.next_in = (Bytef *)data;
+	writer->stream.avail_in = length;
+	int ret;
+	do
+	{
+		ret = deflate( &writer->stream , flush );
+		if( ret==Z_STREAM_ERROR )
+		{
+			writer->failed = true;
+			return;
+		}
+		unsigned int produced = PNG_IDAT_BUFFER_SIZE - writer->stream.avail_out;
+		if( writer->stream.avail_out==0 || ( ret==Z_STREAM_END && produced>0 ) )
+		{
+			if( png_write_chunk( writer->fp , "IDAT" , writer->idatBuffer , produced ) ) writer->failed = true;
+			writer->stream.next_out = writer->idatBuffer;
+			writer->stream.avail_out = PNG_IDAT_BUFFER_SIZE;
+		}
+	}
+	while( !writer->failed && ( writer->stream.avail_in>0 || ( flush==Z_FINISH && ret!=Z_STREAM_END ) ) );
+}
+
+// body of the encoder thread: compresses rows as soon as they are made ready
+static void *png_encoder_thread( void *data )
+{
+	PNGWriter *writer = (PNGWriter *)data;
+	unsigned int length = writer->width * writer->channels;
+
+	while( true )
+	{
+		// wait for new rows (or for the writer to be closed)
+		pthread_mutex_lock( &writer->lock );
+		while( writer->rowsWritten==writer->rowsReady && !writer->closing ) pthread_cond_wait( &writer->rowsChanged , &writer->lock );
+		unsigned int rowsReady = writer->rowsReady;
+		const Image *img = writer->img;
+		pthread_mutex_unlock( &writer->lock );
+
+		if( writer->rowsWritten==rowsReady ) break;
+
+		// the ready rows are final, so they can be read without holding the lock
+		for( ; writer->rowsWritten<rowsReady && !writer->failed ; writer->rowsWritten++ )
+		{
+			unsigned char *row = writer->rawRows[ writer->rowsWritten & 1 ];
+			const unsigned char *prev = writer->rowsWritten ? writer->rawRows[ ( writer->rowsWritten+1 ) & 1 ] : NULL;
+			const Pixel *pixels = img->pixels + writer->rowsWritten * writer->width;
+			for( unsigned int x=0 ; x<writer->width ; x++ )
+			{
+				if( writer->channels==1 ) row[x] = pixels[x].r;
+				else
+				{
+					row[3*x+0] = pixels[x].r;
+					row[3*x+1] = pixels[x].g;
+					row[3*x+2] = pixels[x].b;
+				}
+			}
+			png_deflate( writer , png_filter_row( writer , row , prev ) , length+1 , Z_NO_FLUSH );
+		}
+	}
+
+	if( writer->rowsWritten==writer->height && !writer->failed )
+	{
+		png_deflate( writer , NULL , 0 , Z_FINISH );
+		if( png_write_chunk( writer->fp , "IEND" , NULL , 0 ) ) writer->failed = true;
+	}
+	return NULL;
+}
+
+// frees the buffers and the compressor of a writer
+static void png_free_writer( PNGWriter *writer )
+{
+	deflateEnd( &writer->stream );
+	for( int i=0 ; i<2 ; i++ ) free( writer->rawRows[i] );
+	for( int i=0 ; i<5 ; i++ ) free( writer->filteredRows[i] );
+	free( writer->idatBuffer );
+	free( writer );
+}
+
+PNGWriter *OpenPNGWriter( FILE *fp , unsigned int width , unsigned int height , unsigned int channels )
+{
+	if( fp==NULL || width==0 || height==0 || ( channels!=1 && channels!=3 ) ) return NULL;
+
+	PNGWriter *writer = calloc( 1 , sizeof(PNGWriter) );
+	if( !writer )
+	{
+		fprintf( stderr , "[ERROR] OpenPNGWriter: Failed to allocate writer\n" );
+		return NULL;
+	}
+	writer->fp = fp;
+	writer->width = width;
+	writer->height = height;
+	writer->channels = channels;
+
+	// row buffers (filtered rows carry the filter type byte in front)
+	bool allocated = true;
+	for( int i=0 ; i<2 ; i++ ) allocated &= ( writer->rawRows[i] = malloc( width*channels ) )!=NULL;
+	for( int i=0 ; i<5 ; i++ ) allocated &= ( writer->filteredRows[i] = malloc( width*channels+1 ) )!=NULL;
+	allocated &= ( writer->idatBuffer = malloc( PNG_IDAT_BUFFER_SIZE ) )!=NULL;
+	if( !allocated || deflateInit( &writer->stream , Z_DEFAULT_COMPRESSION )!=Z_OK )
+	{
+		fprintf( stderr , "[ERROR] OpenPNGWriter: Failed to allocate encoder: %d x %d\n" , width , height );
+		png_free_writer( writer );
+		return NULL;
+	}
+	writer->stream.next_out = writer->idatBuffer;
+	writer->stream.avail_out = PNG_IDAT_BUFFER_SIZE;
+
+	// signature and header: 8-bit grayscale or RGB, no interlacing
+	static const unsigned char signature[8] = { 137 , 'P' , 'N' , 'G' , '\r' , '\n' , 26 , '\n' };
+	unsigned char ihdr[13];
+	png_put_uint( ihdr , width );
+	png_put_uint( ihdr+4 , height );
+	ihdr[8] = 8;
+	ihdr[9] = channels==1 ? 0 : 2;
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+	if( fwrite( signature , 1 , 8 , fp )!=8 || png_write_chunk( fp , "IHDR" , ihdr , 13 ) )
+	{
+		fprintf( stderr , "[ERROR] OpenPNGWriter: Failed to write header\n" );
+		png_free_writer( writer );
+		return NULL;
+	}
+
+	pthread_mutex_init( &writer->lock , NULL );
+	pthread_cond_init( &writer->rowsChanged , NULL );
+	if( pthread_create( &writer->thread , NULL , png_encoder_thread , writer ) )
+	{
+		fprintf( stderr , "[ERROR] OpenPNGWriter: Failed to start encoder thread\n" );
+		pthread_mutex_destroy( &writer->lock );
+		pthread_cond_destroy( &writer->rowsChanged );
+		png_free_writer( writer );
+		return NULL;
+	}
+	return writer;
+}
+
+void PNGWriterRowsReady( PNGWriter *writer , const Image *img , unsigned int numRows )
+{
+	if( numRows>writer->height ) numRows = writer->height;
+
+	pthread_mutex_lock( &writer->lock );
+	if( numRows>writer->rowsReady )
+	{
+		writer->img = img;
+		writer->rowsReady = numRows;
+		pthread_cond_signal( &writer->rowsChanged );
+	}
+	pthread_mutex_unlock( &writer->lock );
+}
+
+int ClosePNGWriter( PNGWriter **writer )
+{
+	PNGWriter *w = *writer;
+
+	pthread_mutex_lock( &w->lock );
+	w->closing = true;
+	pthread_cond_signal( &w->rowsChanged );
+	pthread_mutex_unlock( &w->lock );
+	pthread_join( w->thread , NULL );
+
+	int pixels_written = ( w->failed || w->rowsWritten!=w->height ) ? -1 : (int)( w->width * w->height );
+
+	pthread_mutex_destroy( &w->lock );
+	pthread_cond_destroy( &w->rowsChanged );
+	png_free_writer( w );
+	*writer = NULL;
+	return pixels_written;
+}
@@ -0,0 +1,19 @@
+#ifndef PNG_H_INCLUDED
+#define PNG_H_INCLUDED
+
+#include <stdio.h>
+#include "image.h"
+
+/** An opaque struct for a PNG encoder that compresses rows on a background thread*/
+typedef struct PNGWriter PNGWriter;
+
+/** A function that writes the PNG header and starts the background encoder for an image of the given dimensions (1 channel is written as grayscale, 3 as RGB) -- the file handle must stay open until ClosePNGWriter returns (returns NULL if any failure occurs)*/
+PNGWriter *OpenPNGWriter( FILE *fp , unsigned int width , unsigned int height , unsigned int channels );
+
+/** A function that tells the encoder that the first numRows rows of the image are final and can be compressed -- those rows must not be modified afterwards*/
+void PNGWriterRowsReady( PNGWriter *writer , const Image *img , unsigned int numRows );
+
+/** A function that waits for the encoder to compress all the rows, finishes the file and frees the writer (returns -1 if any failure occurs or not all rows were made ready, otherwise the number of pixels written)*/
+int ClosePNGWriter( PNGWriter **writer );
+
+#endif // PNG_H_INCLUDED
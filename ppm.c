@@ -66,11 +66,12 @@ Image *ReadPPM( FILE *fp )
 	/* declare an image (but do not allocate -- yet) */
 	Image *img = NULL;
 
-	/* read in tag; fail if not P6 */
+	/* read in tag; fail if not P6 (color) or P5 (grayscale) */
 	char tag[20];
 	tag[19] = '\0';
 	fscanf( fp , "%19s\n" , tag );
-	if( strncmp( tag , "P6" , 20 ) )
+	bool pgm = !strncmp( tag , "P5" , 20 );
+	if( strncmp( tag , "P6" , 20 ) && !pgm )
 	{
 		fprintf( stderr , "[ERROR] ReadPPM: Not a PPM (bad tag)\n" );
 		return img;
@@ -116,17 +117,24 @@ Image *ReadPPM( FILE *fp )
 	}
 
 	/* finally, read in Pixels */
-	/* read in the binary Pixel data */
+	/* read in the binary Pixel data, one byte per pixel for PGM and three for PPM */
+	unsigned int channels = pgm ? 1 : 3;
+	bool gray = true;
 	for( unsigned int i=0 ; i<(unsigned int)( width*height ) ; i++ )
 	{
-		if( fread( img->pixels+i , sizeof(unsigned char) , 3 , fp )!=3 )
+		if( fread( img->pixels+i , sizeof(unsigned char) , channels , fp )!=channels )
 		{
 			fprintf( stderr, "[ERROR] PPMRead: failed to read pixel from file: %d / %d\n" , i , width*height );
 			FreeImage( &img );
 			return img;
 		}
+		if( pgm ) img->pixels[i].g = img->pixels[i].b = img->pixels[i].r;
 		img->pixels[i].a = 255;
+
+		// a PPM stays single-channel as long as all its pixels are gray
+		if( img->pixels[i].r!=img->pixels[i].g || img->pixels[i].r!=img->pixels[i].b ) gray = false;
 	}
+	img->channels = gray ? 1 : 3;
 
 	// Return the image struct pointer
 	return img;
@@ -157,4 +165,31 @@ int WritePPM( FILE *fp , const Image *img )
 
 	return pixels_written;
 
-}
\ No newline at end of file
+}
+
+
+
+/* Write given image to disk as a PGM, using the red channel.
+* Return -1 if any failure occurs, otherwise return the number of pixels written.
+*/
+int WritePGM( FILE *fp , const Image *img )
+{
+	// Checks if pgm file is valid
+	if (fp == NULL){
+		return -1;
+	}
+
+	// Specifying PGM image tag
+	fprintf(fp, "P5\n %d %d\n 255\n", img->width, img->height);
+
+	// Writing pixels
+	int pixels_written = 0;
+
+	for( unsigned int i=0 ; i<(unsigned int)( (img->width)*(img->height) ) ; i++ ) {
+		fwrite( &img->pixels[i].r , sizeof(unsigned char) , 1 , fp );
+		pixels_written++;
+	}
+
+	return pixels_written;
+
+}
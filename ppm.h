@@ -4,7 +4,7 @@
 #include <stdio.h>
 #include "image.h"
 
-/** A function for reading in PPM files (assumes fp != NULL) */
+/** A function for reading in PPM (P6) and PGM (P5) files -- images whose pixels are all gray are marked as single-channel (assumes fp != NULL) */
 Image *ReadPPM( FILE *fp );
 
 
@@ -12,4 +12,8 @@ Image *ReadPPM( FILE *fp );
 int WritePPM( FILE* fp , const Image *img );
 
 
+/** A function for writing out PGM files using the red channel of the image (return -1 if any failure occurs, otherwise return the number of pixels written) */
+int WritePGM( FILE* fp , const Image *img );
+
+
 #endif // PPM_H_INCLUDED
@@ -1,25 +1,235 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <math.h>
 #include <time.h>
 #include "image.h"
 #include "ppm.h"
 #include "texture_synthesis.h"
+#include "texsynth.h"
+#include "png.h"
+#include "checkpoint.h"
+#include "exemplar_cache.h"
+#include "server.h"
 
 // how to run executable for testing ./project data/D1.ppm tests/D1_test_2.ppm 128 128 2
+//
+// optional flags (may appear anywhere on the command line):
+//   --checkpoint <file>           periodically save the synthesis state to <file>
+//   --checkpoint-interval <n>     number of pixels synthesized between checkpoints
+//   --resume <file>               continue the synthesis saved in the checkpoint <file>
+//   --resynthesize <file>         regenerate part of the existing output <file> (requires --mask)
+//   --mask <file>                 image whose white pixels select the region to regenerate
+//   --batch <n>                   match up to n frontier pixels with disjoint windows per exemplar pass
+//   --budget <n>                  score only n sampled exemplar pixels (plus coherent ones) per pixel
+//   --seeds <n>                   also seed an n x n grid of exemplar crops, each growing its own front
+//   --palette                     match palette indices of the exemplar (quantized to 256 colors if it has more)
+//
+// server mode (no positional arguments): ./project --serve <socket path or - for stdin/stdout>
+//   --cache-size <n>              number of exemplars kept preprocessed between requests
+//
+// the output is written as PPM, or as PGM/PNG if its name ends in .pgm/.png
+
+// Checks whether a file name ends with the given extension
+static bool has_extension( const char *filename , const char *extension )
+{
+	size_t length = strlen(filename);
+	size_t ext_length = strlen(extension);
+	return length >= ext_length && strcmp(filename + length - ext_length, extension) == 0;
+}
+
+// Passes rows completed by the synthesis on to the background PNG encoder
+static void png_rows_completed( const Image *synthesized , unsigned int numRows , void *data )
+{
+	PNGWriterRowsReady((PNGWriter *)data, synthesized, numRows);
+}
+
+// The PNG writer and the image whose pixels back the output buffer of a library synthesis
+typedef struct {
+	PNGWriter *png;
+	const Image *image;
+} PNGRows;
+
+// Passes rows completed by a library synthesis on to the background PNG encoder
+static void png_buffer_rows_completed( const TexSynthBuffer *output , unsigned int numRows , void *data )
+{
+	(void)output;
+	PNGRows *rows = (PNGRows *)data;
+	PNGWriterRowsReady(rows->png, rows->image, numRows);
+}
+
+// Synthesizes a new image from the exemplar through the public library interface, synthesizing
+// directly into the pixels of the returned image (returns NULL on failure)
+static Image *synthesize_with_library( const Image *exemplar , unsigned int outWidth , unsigned int outHeight , unsigned int radius ,
+						const SynthesisOptions *options , PNGWriter *png )
+{
+	Image *synthesized = AllocateImage(outWidth, outHeight);
+	if (synthesized == NULL || synthesized->pixels == NULL) {
+		if (synthesized) FreeImage(&synthesized);
+		return NULL;
+	}
+
+	// Pixels are laid out as RGBA bytes, which the library reads and writes in place
+	TexSynthBuffer exemplarBuffer = { (unsigned char *)exemplar->pixels, exemplar->width, exemplar->height, exemplar->width * sizeof(Pixel), TEXSYNTH_RGBA };
+	TexSynthBuffer outputBuffer = { (unsigned char *)synthesized->pixels, outWidth, outHeight, outWidth * sizeof(Pixel), TEXSYNTH_RGBA };
+	PNGRows rows = { png, synthesized };
+
+	TexSynthParams params;
+	TexSynthDefaultParams(&params);
+	params.windowRadius = radius;
+	params.batchSize = options->batchSize;
+	params.candidateBudget = options->candidateBudget;
+	params.seedGrid = options->seedGrid;
+	params.palette = options->palette;
+	params.checkpointPath = options->checkpointPath;
+	params.checkpointInterval = options->checkpointInterval;
+	if (png != NULL) {
+		params.rowsCompleted = png_buffer_rows_completed;
+		params.rowsCompletedData = &rows;
+	}
+
+	if (TexSynthesize(&exemplarBuffer, &outputBuffer, &params) == -1) {
+		FreeImage(&synthesized);
+		return NULL;
+	}
+	synthesized->channels = exemplar->channels;
+	return synthesized;
+}
+
+// Opens and reads the PPM file with the given name, returning NULL on failure
+static Image *read_ppm_file( const char *filename )
+{
+	FILE *fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		return NULL;
+	}
+	Image *img = ReadPPM(fp);
+	fclose(fp);
+	return img;
+}
 
 int main( int argc , char *argv[] )
 {
 	// Seed the random number generator so that the code produces the same results on the same input.
-	srand(0);
+	SeedSynthesisRandom(0);
+
+	SynthesisOptions options;
+	DefaultSynthesisOptions(&options);
+	const char *resumePath = NULL;
+	const char *resynthesizePath = NULL;
+	const char *maskPath = NULL;
+	const char *servePath = NULL;
+	unsigned int cacheSize = 8;
+
+	// Separate the optional flags from the positional arguments
+	char *positional[6];
+	int num_arguments = 0;
+	for (int i = 0; i < argc; i++) {
+		if (strncmp(argv[i], "--", 2) != 0) {
+			if (num_arguments < 6) {
+				positional[num_arguments] = argv[i];
+			}
+			num_arguments++;
+			continue;
+		}
+		if (strcmp(argv[i], "--palette") == 0) {
+			options.palette = true;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			printf("Error: missing value for %s.\n", argv[i]);
+			return 1;
+		}
+		if (strcmp(argv[i], "--checkpoint") == 0) {
+			options.checkpointPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--checkpoint-interval") == 0) {
+			options.checkpointInterval = atoi(argv[++i]);
+			if (options.checkpointInterval == 0) {
+				printf("Error: checkpoint interval must be positive.\n");
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--resume") == 0) {
+			resumePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--resynthesize") == 0) {
+			resynthesizePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--mask") == 0) {
+			maskPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--serve") == 0) {
+			servePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--cache-size") == 0) {
+			cacheSize = atoi(argv[++i]);
+			if (cacheSize == 0) {
+				printf("Error: cache size must be positive.\n");
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--budget") == 0) {
+			// 0 is valid and means an exhaustive search
+			char *end;
+			long budget = strtol(argv[++i], &end, 10);
+			if (end == argv[i] || *end != '\0' || budget < 0 || budget > UINT_MAX) {
+				printf("Error: budget must be a non-negative integer.\n");
+				return 1;
+			}
+			options.candidateBudget = (unsigned int)budget;
+		}
+		else if (strcmp(argv[i], "--seeds") == 0) {
+			options.seedGrid = atoi(argv[++i]);
+			if (options.seedGrid == 0) {
+				printf("Error: seed grid size must be positive.\n");
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--batch") == 0) {
+			options.batchSize = atoi(argv[++i]);
+			if (options.batchSize == 0) {
+				printf("Error: batch size must be positive.\n");
+				return 1;
+			}
+		}
+		else {
+			printf("Error: unknown option %s.\n", argv[i]);
+			return 1;
+		}
+	}
+
+	// In server mode the requests come from stdin or a socket instead of the command line
+	if (servePath != NULL) {
+		if (num_arguments != 1) {
+			printf("Error: --serve takes no other arguments.\n");
+			return 1;
+		}
+		ExemplarCache *cache = AllocateExemplarCache(cacheSize);
+		if (cache == NULL) {
+			printf("Error: could not allocate exemplar cache.\n");
+			return 5;
+		}
+		int error = strcmp(servePath, "-") == 0 ? ServeSynthesisRequests(stdin, stdout, cache) : ServeSynthesisSocket(servePath, cache);
+		FreeExemplarCache(&cache);
+		if (error == -1) {
+			printf("Error: server failed.\n");
+			return 5;
+		}
+		return 0;
+	}
 
 	// Check if the number of arguments is correct
-	int num_arguments = argc;
-	if (argc != 6) {
+	if (num_arguments != 6) {
 		printf("Error: incorrect number of command line arguments. Please give 6 arguments instead of %d.\n", num_arguments);
 		return 1;
 	}
+	argv = positional;
+	if ((resynthesizePath == NULL) != (maskPath == NULL)) {
+		printf("Error: --resynthesize and --mask must be given together.\n");
+		return 1;
+	}
 
 	// Assign command line arguments to variables
 	unsigned int outWidth = atoi(argv[3]);
@@ -39,7 +249,7 @@ int main( int argc , char *argv[] )
 		return 2;
 	}
 
-	FILE *out = fopen(argv[2], "w");
+	FILE *out = fopen(argv[2], "wb");
 	// check if output file cannot be opened
 	if (out == NULL) {
 		printf("Error: could not open output file.\n");
@@ -59,10 +269,85 @@ int main( int argc , char *argv[] )
 		return 2;
 	}
 
-	Image * synthesized = SynthesizeFromExemplar(exemplar, outWidth, outHeight, radius, 0);
+	// a checkpoint has to match the requested output before anything is written for it
+	if (resumePath != NULL) {
+		unsigned int checkpointWidth, checkpointHeight;
+		if (ReadCheckpointDimensions(resumePath, &checkpointWidth, &checkpointHeight) == -1) {
+			printf("Error: could not resume from checkpoint.\n");
+			return 5;
+		}
+		if (checkpointWidth != outWidth || checkpointHeight != outHeight) {
+			printf("Error: checkpoint dimensions do not match the requested output.\n");
+			return 5;
+		}
+	}
+
+	// PNG output is compressed on a background thread as rows are completed
+	PNGWriter *png = NULL;
+	if (has_extension(argv[2], ".png")) {
+		png = OpenPNGWriter(out, outWidth, outHeight, exemplar->channels);
+		if (png == NULL) {
+			printf("Error: could not write to file.");
+			return 4;
+		}
+		options.rowsCompleted = png_rows_completed;
+		options.rowsCompletedData = png;
+	}
+
+	Image * synthesized = NULL;
+	if (resumePath != NULL) {
+		synthesized = ResumeSynthesisFromCheckpoint(resumePath, exemplar, radius, &options, 0);
+		if (synthesized == NULL) {
+			printf("Error: could not resume from checkpoint.\n");
+			return 5;
+		}
+		if (synthesized->width != outWidth || synthesized->height != outHeight) {
+			printf("Error: checkpoint dimensions do not match the requested output.\n");
+			return 5;
+		}
+	}
+	else if (resynthesizePath != NULL) {
+		Image *existing = read_ppm_file(resynthesizePath);
+		Image *mask = read_ppm_file(maskPath);
+		if (existing == NULL || mask == NULL) {
+			printf("Error: could not read image or mask to resynthesize.\n");
+			return 3;
+		}
+		if (existing->width != outWidth || existing->height != outHeight) {
+			printf("Error: image to resynthesize does not match the requested output dimensions.\n");
+			return 5;
+		}
+		synthesized = ResynthesizeRegion(exemplar, existing, mask, radius, &options, 0);
+		FreeImage(&existing);
+		FreeImage(&mask);
+		if (synthesized == NULL) {
+			printf("Error: could not resynthesize region.\n");
+			return 5;
+		}
+	}
+	else {
+		synthesized = synthesize_with_library(exemplar, outWidth, outHeight, radius, &options, png);
+		if (synthesized == NULL) {
+			if (png != NULL) {
+				ClosePNGWriter(&png);
+			}
+			printf("Error: could not synthesize texture.\n");
+			return 5;
+		}
+	}
 
-	// Write ppm image to file. If there is an error 
-	int error = WritePPM(out, synthesized);
+	// Write ppm image to file (or pgm/png depending on the output file name). If there is an error 
+	int error;
+	if (png != NULL) {
+		PNGWriterRowsReady(png, synthesized, outHeight);
+		error = ClosePNGWriter(&png);
+	}
+	else if (has_extension(argv[2], ".pgm")) {
+		error = WritePGM(out, synthesized);
+	}
+	else {
+		error = WritePPM(out, synthesized);
+	}
 	if (error == -1) {
 		printf("Error: could not write to file.");
 		return 4;
@@ -0,0 +1,192 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "ppm.h"
+#include "texture_synthesis.h"
+
+#define SERVER_LINE_LENGTH 4096
+#define SERVER_MAX_TOKENS 16
+
+// the largest output width or height accepted, so that a single request cannot exhaust memory
+#define SERVER_MAX_DIMENSION 16384
+
+// result of answering a single request
+enum { SERVER_CONTINUE , SERVER_QUIT , SERVER_FAILED };
+
+// helper function returning the time elapsed since start in milliseconds
+static double server_elapsed_ms( const struct timespec *start )
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC , &now );
+	return ( now.tv_sec - start->tv_sec )*1e3 + ( now.tv_nsec - start->tv_nsec )/1e6;
+}
+
+// helper function parsing a positive integer (returns false if the string is not one)
+static bool server_parse_uint( const char *str , unsigned int *value )
+{
+	char *end;
+	long v = strtol( str , &end , 10 );
+	if( end==str || *end || v<=0 ) return false;
+	*value = (unsigned int)v;
+	return true;
+}
+
+// answers a synthesize request given its tokens (not including the command)
+static int server_synthesize( char **tokens , int numTokens , FILE *out , ExemplarCache *cache )
+{
+	struct timespec start;
+	clock_gettime( CLOCK_MONOTONIC , &start );
+
+	unsigned int width , height , radius;
+	if( numTokens<5 || !server_parse_uint( tokens[2] , &width ) || !server_parse_uint( tokens[3] , &height ) || !server_parse_uint( tokens[4] , &radius ) )
+		return fprintf( out , "error usage: synthesize <exemplar> <output> <width> <height> <radius> [batch=<n>] [budget=<n>] [seeds=<n>] [palette]\n" )<0 ? SERVER_FAILED : SERVER_CONTINUE;
+
+	if( width>SERVER_MAX_DIMENSION || height>SERVER_MAX_DIMENSION )
+		return fprintf( out , "error output larger than %d x %d\n" , SERVER_MAX_DIMENSION , SERVER_MAX_DIMENSION )<0 ? SERVER_FAILED : SERVER_CONTINUE;
+
+	SynthesisOptions options;
+	DefaultSynthesisOptions( &options );
+	for( int i=5 ; i<numTokens ; i++ )
+	{
+		if( !strncmp( tokens[i] , "batch=" , 6 ) && server_parse_uint( tokens[i]+6 , &options.batchSize ) ) continue;
+		if( !strncmp( tokens[i] , "budget=" , 7 ) && server_parse_uint( tokens[i]+7 , &options.candidateBudget ) ) continue;
+		if( !strcmp( tokens[i] , "palette" ) )
+		{
+			options.palette = true;
+			continue;
+		}
+		if( !strncmp( tokens[i] , "seeds=" , 6 ) && server_parse_uint( tokens[i]+6 , &options.seedGrid ) ) continue;
+		return fprintf( out , "error unknown option %s\n" , tokens[i] )<0 ? SERVER_FAILED : SERVER_CONTINUE;
+	}
+
+	bool hit;
+	const ExemplarCacheEntry *entry = GetCachedExemplar( cache , tokens[0] , options.palette , &hit );
+	if( !entry ) return fprintf( out , "error could not read exemplar %s\n" , tokens[0] )<0 ? SERVER_FAILED : SERVER_CONTINUE;
+	options.packedExemplar = options.palette ? entry->palettePacked : entry->packed;
+
+	// every request is seeded like a fresh run so that it produces the same image as the command line
+	SeedSynthesisRandom( 0 );
+	Image *synthesized = SynthesizeFromExemplarWithOptions( entry->exemplar , width , height , radius , &options , 0 );
+	if( !synthesized ) return fprintf( out , "error synthesis failed (window larger than the exemplar, output smaller than the exemplar, or out of memory)\n" )<0 ? SERVER_FAILED : SERVER_CONTINUE;
+
+	int result = SERVER_CONTINUE;
+	if( !strcmp( tokens[1] , "-" ) )
+	{
+		// the image is written to memory first so that its size can precede it
+		char *buffer = NULL;
+		size_t size = 0;
+		FILE *mem = open_memstream( &buffer , &size );
+		int error = mem ? WritePPM( mem , synthesized ) : -1;
+		if( mem ) fclose( mem );
+		if( error==-1 ) result = fprintf( out , "error could not encode image\n" )<0 ? SERVER_FAILED : SERVER_CONTINUE;
+		else if( fprintf( out , "ok %.2f %s %zu\n" , server_elapsed_ms( &start ) , hit ? "hit" : "miss" , size )<0 || fwrite( buffer , 1 , size , out )!=size ) result = SERVER_FAILED;
+		free( buffer );
+	}
+	else
+	{
+		FILE *fp = fopen( tokens[1] , "wb" );
+		int error = fp ? WritePPM( fp , synthesized ) : -1;
+		if( fp && fclose( fp ) ) error = -1;
+		if( error==-1 ) result = fprintf( out , "error could not write %s\n" , tokens[1] )<0 ? SERVER_FAILED : SERVER_CONTINUE;
+		else if( fprintf( out , "ok %.2f %s\n" , server_elapsed_ms( &start ) , hit ? "hit" : "miss" )<0 ) result = SERVER_FAILED;
+	}
+	FreeImage( &synthesized );
+	return result;
+}
+
+// reads and answers a single request line
+static int server_handle_line( char *line , FILE *out , ExemplarCache *cache )
+{
+	char *tokens[SERVER_MAX_TOKENS];
+	int numTokens = 0;
+	for( char *token=strtok( line , " \t\r\n" ) ; token && numTokens<SERVER_MAX_TOKENS ; token=strtok( NULL , " \t\r\n" ) ) tokens[numTokens++] = token;
+
+	int result;
+	if( numTokens==0 ) return SERVER_CONTINUE;
+	else if( !strcmp( tokens[0] , "quit" ) ) return SERVER_QUIT;
+	else if( !strcmp( tokens[0] , "synthesize" ) ) result = server_synthesize( tokens+1 , numTokens-1 , out , cache );
+	else result = fprintf( out , "error unknown request %s\n" , tokens[0] )<0 ? SERVER_FAILED : SERVER_CONTINUE;
+	if( result!=SERVER_FAILED && fflush( out ) ) result = SERVER_FAILED;
+	return result;
+}
+
+int ServeSynthesisRequests( FILE *in , FILE *out , ExemplarCache *cache )
+{
+	char line[SERVER_LINE_LENGTH];
+	while( fgets( line , SERVER_LINE_LENGTH , in ) )
+	{
+		int result = server_handle_line( line , out , cache );
+		if( result==SERVER_QUIT ) return 1;
+		if( result==SERVER_FAILED )
+		{
+			fprintf( stderr , "[ERROR] ServeSynthesisRequests: Failed to write reply\n" );
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int ServeSynthesisSocket( const char *socketPath , ExemplarCache *cache )
+{
+	struct sockaddr_un address;
+	memset( &address , 0 , sizeof(address) );
+	address.sun_family = AF_UNIX;
+	if( strlen( socketPath )>=sizeof(address.sun_path) )
+	{
+		fprintf( stderr , "[ERROR] ServeSynthesisSocket: Socket path too long: %s\n" , socketPath );
+		return -1;
+	}
+	strcpy( address.sun_path , socketPath );
+
+	int listener = socket( AF_UNIX , SOCK_STREAM , 0 );
+	if( listener<0 )
+	{
+		fprintf( stderr , "[ERROR] ServeSynthesisSocket: Failed to create socket\n" );
+		return -1;
+	}
+	unlink( socketPath );
+	if( bind( listener , (struct sockaddr *)&address , sizeof(address) ) || listen( listener , 8 ) )
+	{
+		fprintf( stderr , "[ERROR] ServeSynthesisSocket: Failed to listen on socket: %s\n" , socketPath );
+		close( listener );
+		return -1;
+	}
+
+	// a client that disconnects before its reply makes the write fail instead of killing the server,
+	// and the failed write only ends that client's connection
+	signal( SIGPIPE , SIG_IGN );
+
+	// connections are answered one at a time; a quit request from any of them stops the server
+	bool quit = false;
+	while( !quit )
+	{
+		int connection = accept( listener , NULL , NULL );
+		if( connection<0 ) continue;
+		FILE *in = fdopen( connection , "r" );
+		int outFd = dup( connection );
+		FILE *out = outFd<0 ? NULL : fdopen( outFd , "w" );
+		if( !in || !out )
+		{
+			if( in ) fclose( in );
+			else close( connection );
+			if( out ) fclose( out );
+			else if( outFd>=0 ) close( outFd );
+			continue;
+		}
+
+		quit = ServeSynthesisRequests( in , out , cache )==1;
+		fclose( in );
+		fclose( out );
+	}
+	close( listener );
+	unlink( socketPath );
+	return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef SERVER_H_INCLUDED
+#define SERVER_H_INCLUDED
+
+#include <stdio.h>
+#include "exemplar_cache.h"
+
+/** A function answering synthesis requests read line by line from in, writing the replies to out and keeping the exemplars in the given cache, until the input ends or a quit request is read -- requests are
+ *  "synthesize <exemplar> <output> <width> <height> <radius> [batch=<n>] [budget=<n>] [seeds=<n>] [palette]", answered by "ok <milliseconds> hit|miss" (or, if the output is "-", by "ok <milliseconds> hit|miss <bytes>" followed by the image as PPM), or by "error <message>"
+ *  (returns 1 after a quit request, 0 at the end of the input, or -1 if writing a reply failed) */
+int ServeSynthesisRequests( FILE *in , FILE *out , ExemplarCache *cache );
+
+/** A function listening on the Unix socket with the given path and answering the requests of each connection in turn, sharing the given cache across connections (returns -1 if the socket cannot be set up, otherwise runs until a quit request is read and returns 0) */
+int ServeSynthesisSocket( const char *socketPath , ExemplarCache *cache );
+
+#endif // SERVER_H_INCLUDED
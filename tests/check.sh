@@ -0,0 +1,63 @@
+#!/bin/sh
+# Regression checks for the promises the synthesis makes about its output:
+#   - a run resumed from a checkpoint is bit-identical to an uninterrupted one
+#   - --batch 1 reproduces the default sequential growth exactly
+#   - --palette reproduces the default output for exemplars with at most 256 colors
+# Run with "make check" from the repository root.
+
+PROJECT=./project
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+failures=0
+
+# runs the project quietly, failing the check if it does not succeed
+run() {
+	if ! "$PROJECT" "$@" > "$TMP/log" 2>&1; then
+		cat "$TMP/log"
+		return 1
+	fi
+}
+
+# reports whether two files are identical
+same() {
+	name=$1
+	shift
+	if cmp -s "$1" "$2"; then
+		echo "PASS: $name"
+	else
+		echo "FAIL: $name"
+		failures=$((failures + 1))
+	fi
+}
+
+# The last checkpoint of a finished run holds a partial image (the interval does not divide the
+# number of synthesized pixels), so resuming from it has to reproduce the rest of the run.
+resume_check() {
+	name=$1
+	shift
+	run data/D1.ppm "$TMP/full.ppm" 80 80 2 "$@" --checkpoint "$TMP/ck" --checkpoint-interval 700 &&
+	run data/D1.ppm "$TMP/resumed.ppm" 80 80 2 "$@" --resume "$TMP/ck" &&
+	same "resume $name" "$TMP/full.ppm" "$TMP/resumed.ppm" || failures=$((failures + 1))
+}
+
+resume_check "default"
+resume_check "--batch 3" --batch 3
+resume_check "--budget 32" --budget 32
+resume_check "--seeds 2 --batch 4" --seeds 2 --batch 4
+resume_check "--palette" --palette
+
+run data/D1.ppm "$TMP/default.ppm" 72 72 2 &&
+run data/D1.ppm "$TMP/batch1.ppm" 72 72 2 --batch 1 &&
+same "--batch 1 equals default" "$TMP/default.ppm" "$TMP/batch1.ppm" || failures=$((failures + 1))
+
+for exemplar in D1 161; do
+	run data/$exemplar.ppm "$TMP/default.ppm" 72 72 2 &&
+	run data/$exemplar.ppm "$TMP/palette.ppm" 72 72 2 --palette &&
+	same "--palette equals default ($exemplar)" "$TMP/default.ppm" "$TMP/palette.ppm" || failures=$((failures + 1))
+done
+
+if [ "$failures" -ne 0 ]; then
+	echo "$failures check(s) failed"
+	exit 1
+fi
+echo "all checks passed"
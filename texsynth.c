@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "texsynth.h"
+#include "image.h"
+#include "texture_synthesis.h"
+
+// Tightly packed RGBA buffers share the layout of the Pixel struct, so they are
+// synthesized in place; other layouts go through a working image.
+
+// helper function checking that a buffer describes a usable image
+static int texsynth_check_buffer( const TexSynthBuffer *buffer , const char *name )
+{
+	if( !buffer->data || !buffer->width || !buffer->height ||
+		( buffer->layout!=TEXSYNTH_GRAY && buffer->layout!=TEXSYNTH_RGB && buffer->layout!=TEXSYNTH_RGBA ) ||
+		buffer->stride < (size_t)buffer->width * buffer->layout )
+	{
+		fprintf( stderr , "[ERROR] TexSynthesize: Invalid %s buffer\n" , name );
+		return -1;
+	}
+	return 0;
+}
+
+// helper function checking whether a buffer can be used as the pixels of an image directly
+static int texsynth_is_pixel_layout( const TexSynthBuffer *buffer )
+{
+	return sizeof(Pixel)==4 && buffer->layout==TEXSYNTH_RGBA && buffer->stride==(size_t)buffer->width*4;
+}
+
+// helper function copying a buffer into the pixels of an image of the same dimensions
+static void texsynth_read_buffer( const TexSynthBuffer *buffer , Image *img )
+{
+	bool gray = true;
+	for( unsigned int y=0 ; y<buffer->height ; y++ )
+	{
+		const unsigned char *row = buffer->data + y*buffer->stride;
+		for( unsigned int x=0 ; x<buffer->width ; x++ )
+		{
+			const unsigned char *p = row + x*buffer->layout;
+			Pixel *q = img->pixels + y*img->width + x;
+			q->r = p[0];
+			q->g = buffer->layout==TEXSYNTH_GRAY ? p[0] : p[1];
+			q->b = buffer->layout==TEXSYNTH_GRAY ? p[0] : p[2];
+			q->a = 255;
+			gray = gray && q->r==q->g && q->g==q->b;
+		}
+	}
+	img->channels = gray ? 1 : 3;
+}
+
+// helper function copying the rows [firstRow,lastRow) of an image into a buffer of the same dimensions
+static void texsynth_write_buffer( const Image *img , const TexSynthBuffer *buffer , unsigned int firstRow , unsigned int lastRow )
+{
+	for( unsigned int y=firstRow ; y<lastRow ; y++ )
+	{
+		unsigned char *row = buffer->data + y*buffer->stride;
+		for( unsigned int x=0 ; x<buffer->width ; x++ )
+		{
+			unsigned char *p = row + x*buffer->layout;
+			const Pixel *q = img->pixels + y*img->width + x;
+			p[0] = q->r;
+			if( buffer->layout==TEXSYNTH_GRAY ) continue;
+			p[1] = q->g;
+			p[2] = q->b;
+			if( buffer->layout==TEXSYNTH_RGBA ) p[3] = q->a;
+		}
+	}
+}
+
+// the state needed to pass completed rows of the working image on to the caller
+typedef struct
+{
+	const TexSynthParams *params;
+	const TexSynthBuffer *output;
+
+	// the working image (NULL if the synthesis writes into the output buffer directly) and the number of its rows copied so far
+	const Image *working;
+	unsigned int rowsCopied;
+} TexSynthRows;
+
+// helper function copying newly completed rows into the output buffer before reporting them to the caller
+static void texsynth_rows_completed( const Image *synthesized , unsigned int numRows , void *data )
+{
+	TexSynthRows *rows = (TexSynthRows *)data;
+	if( rows->working ) texsynth_write_buffer( synthesized , rows->output , rows->rowsCopied , numRows );
+	rows->rowsCopied = numRows;
+	if( rows->params->rowsCompleted ) rows->params->rowsCompleted( rows->output , numRows , rows->params->rowsCompletedData );
+}
+
+void TexSynthDefaultParams( TexSynthParams *params )
+{
+	params->windowRadius = 2;
+	params->seed = 0;
+	params->batchSize = 1;
+	params->candidateBudget = 0;
+	params->seedGrid = 1;
+	params->palette = 0;
+	params->checkpointPath = NULL;
+	params->checkpointInterval = 4096;
+	params->rowsCompleted = NULL;
+	params->rowsCompletedData = NULL;
+}
+
+int TexSynthesize( const TexSynthBuffer *exemplar , const TexSynthBuffer *output , const TexSynthParams *params )
+{
+	if( texsynth_check_buffer( exemplar , "exemplar" ) || texsynth_check_buffer( output , "output" ) ) return -1;
+	if( !params->batchSize )
+	{
+		fprintf( stderr , "[ERROR] TexSynthesize: Batch size must be positive\n" );
+		return -1;
+	}
+	if( !params->seedGrid )
+	{
+		fprintf( stderr , "[ERROR] TexSynthesize: Seed grid size must be positive\n" );
+		return -1;
+	}
+	if( params->checkpointPath && !params->checkpointInterval )
+	{
+		fprintf( stderr , "[ERROR] TexSynthesize: Checkpoint interval must be positive\n" );
+		return -1;
+	}
+
+	// the exemplar is always read into a working image: its color channels are checked for
+	// grayscale, and it is packed for matching by the synthesis anyway
+	Image *ex = AllocateImage( exemplar->width , exemplar->height );
+	if( !ex ) return -1;
+	texsynth_read_buffer( exemplar , ex );
+
+	// the output is synthesized in place when the caller's buffer is laid out like an image
+	Image view = { output->width , output->height , 3 , (Pixel *)output->data };
+	Image *synthesized = texsynth_is_pixel_layout( output ) ? &view : AllocateImage( output->width , output->height );
+	if( !synthesized || !synthesized->pixels )
+	{
+		fprintf( stderr , "[ERROR] TexSynthesize: Failed to allocate image: %d x %d\n" , output->width , output->height );
+		if( synthesized ) FreeImage( &synthesized );
+		FreeImage( &ex );
+		return -1;
+	}
+	TexSynthRows rows = { params , output , synthesized==&view ? NULL : synthesized , 0 };
+
+	SynthesisOptions options;
+	DefaultSynthesisOptions( &options );
+	options.batchSize = params->batchSize;
+	options.candidateBudget = params->candidateBudget;
+	options.seedGrid = params->seedGrid;
+	options.palette = params->palette != 0;
+	options.checkpointPath = params->checkpointPath;
+	options.checkpointInterval = params->checkpointInterval;
+	options.rowsCompleted = texsynth_rows_completed;
+	options.rowsCompletedData = &rows;
+	SeedSynthesisRandom( params->seed );
+	int error = SynthesizeIntoImage( ex , synthesized , params->windowRadius , &options , 0 );
+
+	if( synthesized!=&view )
+	{
+		if( !error ) texsynth_write_buffer( synthesized , output , rows.rowsCopied , output->height );
+		FreeImage( &synthesized );
+	}
+	FreeImage( &ex );
+	return error;
+}
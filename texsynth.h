@@ -0,0 +1,85 @@
+#ifndef TEXSYNTH_H_INCLUDED
+#define TEXSYNTH_H_INCLUDED
+
+#include <stddef.h>
+
+// Public interface of libtexsynth: synthesizes a texture from an exemplar held in a
+// caller-owned pixel buffer directly into a caller-owned output buffer.
+// The synthesis uses a library-wide random number generator, so calls must not overlap.
+
+// only the functions marked TEXSYNTH_API are exported from the shared library
+#if defined(__GNUC__)
+#define TEXSYNTH_API __attribute__((visibility("default")))
+#else
+#define TEXSYNTH_API
+#endif
+
+/** The layouts of the pixels in a buffer (the value is the number of bytes per pixel)*/
+typedef enum
+{
+	TEXSYNTH_GRAY = 1 ,
+	TEXSYNTH_RGB = 3 ,
+	TEXSYNTH_RGBA = 4
+} TexSynthLayout;
+
+/** A struct describing a caller-owned pixel buffer*/
+typedef struct
+{
+	/** The first byte of the top row of pixels*/
+	unsigned char *data;
+
+	/** The width of the image in pixels*/
+	unsigned int width;
+
+	/** The height of the image in pixels*/
+	unsigned int height;
+
+	/** The number of bytes between the starts of consecutive rows (at least width times the bytes per pixel)*/
+	size_t stride;
+
+	/** The layout of each pixel*/
+	TexSynthLayout layout;
+} TexSynthBuffer;
+
+/** A struct storing the settings of a synthesis*/
+typedef struct
+{
+	/** The radius of the window matched around each synthesized pixel*/
+	unsigned int windowRadius;
+
+	/** The seed of the random number generator (the same seed and inputs always produce the same output)*/
+	unsigned int seed;
+
+	/** The maximum number of frontier pixels with disjoint windows matched together in one pass over the exemplar*/
+	unsigned int batchSize;
+
+	/** The number of exemplar pixels sampled per synthesized pixel, in addition to those continuing the neighbors' sources (0 searches the whole exemplar)*/
+	unsigned int candidateBudget;
+
+	/** The number of rows and columns of the grid of exemplar crops seeded across the output in addition to the top-left copy (1 for a single front)*/
+	unsigned int seedGrid;
+
+	/** Whether the exemplar is matched as indices into a palette of at most 256 colors (quantizing it if it has more)*/
+	int palette;
+
+	/** The file that the synthesis state is periodically saved to (or NULL to disable checkpointing)*/
+	const char *checkpointPath;
+
+	/** The number of pixels synthesized between consecutive checkpoints*/
+	unsigned int checkpointInterval;
+
+	/** A function called with the number of leading rows of the output buffer that are final, whenever that number grows (or NULL)*/
+	void (*rowsCompleted)( const TexSynthBuffer *output , unsigned int numRows , void *data );
+
+	/** The data passed on to rowsCompleted*/
+	void *rowsCompletedData;
+} TexSynthParams;
+
+/** A function that fills in the default settings (a window radius of 2, seed 0, exact sequential matching from a single front, no checkpoints or row notifications)*/
+TEXSYNTH_API void TexSynthDefaultParams( TexSynthParams *params );
+
+/** A function that fills the output buffer with a texture synthesized from the exemplar buffer -- the output must be at least as large as the exemplar, which is copied into its top-left corner, and RGBA output receives an opaque alpha channel
+ *  (returns -1 if the buffers or settings are invalid -- e.g. a window larger than the exemplar -- or the synthesis fails, and 0 otherwise) */
+TEXSYNTH_API int TexSynthesize( const TexSynthBuffer *exemplar , const TexSynthBuffer *output , const TexSynthParams *params );
+
+#endif // TEXSYNTH_H_INCLUDED
@@ -7,6 +7,47 @@
 #include <assert.h>
 #include "image.h"
 #include "texture_synthesis.h"
+#include "checkpoint.h"
+#include "bitmap.h"
+
+// State of the synthesis random number generator. A generator with an explicit state
+// is used instead of rand() so that the state can be saved to and restored from a checkpoint.
+static unsigned long long synthesisRandomState = 0;
+
+void SeedSynthesisRandom( unsigned int seed )
+{
+	synthesisRandomState = seed;
+}
+
+// 64-bit linear congruential generator (Knuth's MMIX constants), returning the high bits
+int SynthesisRandom( void )
+{
+	synthesisRandomState = synthesisRandomState * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (int)( ( synthesisRandomState>>33 ) % ( (unsigned long long)RAND_MAX + 1 ) );
+}
+
+unsigned long long GetSynthesisRandomState( void )
+{
+	return synthesisRandomState;
+}
+
+void SetSynthesisRandomState( unsigned long long state )
+{
+	synthesisRandomState = state;
+}
+
+void DefaultSynthesisOptions( SynthesisOptions *options )
+{
+	options->checkpointPath = NULL;
+	options->checkpointInterval = 4096;
+	options->batchSize = 1;
+	options->candidateBudget = 0;
+	options->packedExemplar = NULL;
+	options->palette = false;
+	options->seedGrid = 1;
+	options->rowsCompleted = NULL;
+	options->rowsCompletedData = NULL;
+}
 
 // compares tbs pixels 
 int CompareTBSPixels( const void *v1 , const void *v2 )
@@ -35,8 +76,8 @@ int SortTBSPixels( TBSPixel *tbsPixels , unsigned int sz )
 	for( unsigned int i=0 ; i<sz ; i++ ) permutation[i] = i;
 	for( unsigned int i=0 ; i<sz ; i++ )
 	{
-		unsigned int i1 = rand() % sz;
-		unsigned int i2 = rand() % sz;
+		unsigned int i1 = SynthesisRandom() % sz;
+		unsigned int i2 = SynthesisRandom() % sz;
 		unsigned int tmp = permutation[i1];
 		permutation[i1] = permutation[i2];
 		permutation[i2] = tmp;
@@ -50,14 +91,71 @@ int SortTBSPixels( TBSPixel *tbsPixels , unsigned int sz )
 	return 0;
 }
 
+// Checks that a window fits inside the exemplar: otherwise no exemplar pixel can be a
+// candidate, and there would be nothing to pick from
+bool windowFitsExemplar(const Image *exemplar, unsigned int windowRadius) {
+	if (2*windowRadius + 1 > exemplar->width || 2*windowRadius + 1 > exemplar->height) {
+		fprintf( stderr , "[ERROR] Window radius %d too large for a %d x %d exemplar\n" , windowRadius , exemplar->width , exemplar->height );
+		return false;
+	}
+	return true;
+}
+
 // Synthesizes output image from exemplar image
 Image *SynthesizeFromExemplar( const Image *exemplar , unsigned int outWidth , unsigned int outHeight , unsigned int windowRadius , bool verbose )
+{
+	SynthesisOptions options;
+	DefaultSynthesisOptions(&options);
+	return SynthesizeFromExemplarWithOptions(exemplar, outWidth, outHeight, windowRadius, &options, verbose);
+}
+
+// Synthesizes output image from exemplar image using the given options
+Image *SynthesizeFromExemplarWithOptions( const Image *exemplar , unsigned int outWidth , unsigned int outHeight , unsigned int windowRadius ,
+						const SynthesisOptions *options , bool verbose )
 {
 	// output image pointer initialized to null
 	Image *synthesized = NULL;
 	
 	// set parameters for synthesized
 	synthesized = AllocateImage(outWidth, outHeight);
+	if (synthesized == NULL || synthesized->pixels == NULL) {
+		fprintf( stderr , "[ERROR] SynthesizeFromExemplarWithOptions: Failed to allocate image: %d x %d\n" , outWidth , outHeight );
+		if (synthesized) FreeImage(&synthesized);
+		return NULL;
+	}
+
+	if (SynthesizeIntoImage(exemplar, synthesized, windowRadius, options, verbose) == -1) {
+		FreeImage(&synthesized);
+		return NULL;
+	}
+	return synthesized;
+}
+
+// Synthesizes output image from exemplar image into an image allocated by the caller
+int SynthesizeIntoImage( const Image *exemplar , Image *synthesized , unsigned int windowRadius ,
+						const SynthesisOptions *options , bool verbose )
+{
+	unsigned int outWidth = synthesized->width;
+	unsigned int outHeight = synthesized->height;
+	if (!windowFitsExemplar(exemplar, windowRadius)) {
+		return -1;
+	}
+	// the exemplar is copied into the top-left corner of the output
+	if (exemplar->width > outWidth || exemplar->height > outHeight) {
+		fprintf( stderr , "[ERROR] SynthesizeIntoImage: Output smaller than exemplar: %d x %d < %d x %d\n" , outWidth , outHeight , exemplar->width , exemplar->height );
+		return -1;
+	}
+	synthesized->channels = exemplar->channels;
+
+	// bitmap of the set pixels, initially all unset, and the exemplar pixel each of them was copied from
+	Bitmap *set = AllocateBitmap(outWidth, outHeight);
+	PixelIndex *sources = createSourceMap(outWidth, outHeight);
+	if (set == NULL || sources == NULL) {
+		fprintf( stderr , "[ERROR] Failed to allocate set bitmap: %d x %d\n" , outWidth , outHeight );
+		if (set) FreeBitmap(&set);
+		free(sources);
+		return -1;
+	}
 
 	// TESTING: setting all pixels to grey first for visibility (only for testing purposes)
 	if (verbose == 1) {
@@ -65,19 +163,17 @@ Image *SynthesizeFromExemplar( const Image *exemplar , unsigned int outWidth , u
 			synthesized->pixels[i].r = 50;
 			synthesized->pixels[i].g = 50;
 			synthesized->pixels[i].b = 50;
-
-			// even though pixel is grey, still considered unset
-			synthesized->pixels[i].a = 0;
+			synthesized->pixels[i].a = 255;
 		}
 	}
 
-	// sets all pixels in black and unset if verbose is 0;
+	// sets all pixels in black if verbose is 0;
 	else {
 			for( unsigned int i=0 ; i<(unsigned int)( (outWidth)*(outHeight) ) ; i++ ) {
 				synthesized->pixels[i].r = 0;
 				synthesized->pixels[i].g = 0;
 				synthesized->pixels[i].b = 0;
-				synthesized->pixels[i].a = 0;
+				synthesized->pixels[i].a = 255;
 		}
 	}
 	
@@ -94,70 +190,264 @@ Image *SynthesizeFromExemplar( const Image *exemplar , unsigned int outWidth , u
 			Pixel ex_pixel = exemplar->pixels[ i*ex_w + j ];
 
 			// corresponding in the synthesized image
-			Pixel *img_pixel = &(synthesized->pixels[ i*outWidth + j ]);
+			PixelIndex img_idx = { j, i };
 
 			// set the color of the synthesized pixel to the color of the exemplar pixel
 			// in the width and height of the exemplar
-			setPixel(img_pixel, ex_pixel);
+			setPixel(synthesized, set, img_idx, ex_pixel);
+			sources[i*outWidth + j].x = j;
+			sources[i*outWidth + j].y = i;
 		}
 	}
 	
+	// scatter crops of the exemplar over the rest of the output so that several fronts grow at once
+	if (options->seedGrid > 1) {
+		placeSeedPatches(synthesized, set, sources, exemplar, windowRadius, options->seedGrid);
+	}
+
 	// synthesize all pixels
-	synthesizeTexture(synthesized, ex_w, ex_h, outWidth, outHeight, windowRadius);
+	synthesizeTexture(synthesized, set, sources, exemplar, windowRadius, options);
+
+	FreeBitmap(&set);
+	free(sources);
+	return 0;
+}
+
+// Reads the partial image and random number generator state from a checkpoint
+// and synthesizes the remaining pixels
+Image *ResumeSynthesisFromCheckpoint( const char *checkpointPath , const Image *exemplar , unsigned int windowRadius ,
+						const SynthesisOptions *options , bool verbose )
+{
+	if (!windowFitsExemplar(exemplar, windowRadius)) {
+		return NULL;
+	}
+
+	CheckpointHeader header;
+	Bitmap *set = NULL;
+	PixelIndex *sources = NULL;
+	Image *synthesized = ReadCheckpoint(checkpointPath, &header, &set, &sources);
+	if (synthesized == NULL) {
+		return NULL;
+	}
+
+	// the checkpoint has to come from a run with the same exemplar dimensions and window radius
+	if (header.exWidth != exemplar->width || header.exHeight != exemplar->height || header.windowRadius != windowRadius) {
+		fprintf( stderr , "[ERROR] ResumeSynthesisFromCheckpoint: Checkpoint was written for a %d x %d exemplar with radius %d\n" ,
+					header.exWidth , header.exHeight , header.windowRadius );
+		FreeImage(&synthesized);
+		FreeBitmap(&set);
+		free(sources);
+		return NULL;
+	}
+
+	// and with the same options, since they change which pixels are picked
+	if (header.batchSize != options->batchSize || header.candidateBudget != options->candidateBudget ||
+			header.seedGrid != options->seedGrid || header.palette != (options->palette ? 1u : 0u)) {
+		fprintf( stderr , "[ERROR] ResumeSynthesisFromCheckpoint: Checkpoint was written with batch size %d, budget %d, seed grid %d and palette %s\n" ,
+					header.batchSize , header.candidateBudget , header.seedGrid , header.palette ? "on" : "off" );
+		FreeImage(&synthesized);
+		FreeBitmap(&set);
+		free(sources);
+		return NULL;
+	}
+	if (verbose) {
+		printf("Resuming synthesis from %s\n", checkpointPath);
+	}
+
+	synthesized->channels = exemplar->channels;
+	SetSynthesisRandomState(header.randState);
+	synthesizeTexture(synthesized, set, sources, exemplar, windowRadius, options);
+
+	FreeBitmap(&set);
+	free(sources);
+	return synthesized;
+}
+
+// Copies an existing image, unsets the pixels selected by the mask and
+// synthesizes them again from the exemplar
+Image *ResynthesizeRegion( const Image *exemplar , const Image *existing , const Image *mask , unsigned int windowRadius ,
+						const SynthesisOptions *options , bool verbose )
+{
+	if (!windowFitsExemplar(exemplar, windowRadius)) {
+		return NULL;
+	}
+	if (mask->width != existing->width || mask->height != existing->height) {
+		fprintf( stderr , "[ERROR] ResynthesizeRegion: Mask is %d x %d but the image is %d x %d\n" ,
+					mask->width , mask->height , existing->width , existing->height );
+		return NULL;
+	}
+
+	Image *synthesized = AllocateImage(existing->width, existing->height);
+	if (synthesized == NULL || synthesized->pixels == NULL) {
+		fprintf( stderr , "[ERROR] ResynthesizeRegion: Failed to allocate image: %d x %d\n" , existing->width , existing->height );
+		return NULL;
+	}
+
+	synthesized->channels = exemplar->channels;
+
+	// the exemplar pixels the existing pixels came from are not known
+	Bitmap *set = AllocateBitmap(existing->width, existing->height);
+	PixelIndex *sources = createSourceMap(existing->width, existing->height);
+	if (set == NULL || sources == NULL) {
+		fprintf( stderr , "[ERROR] ResynthesizeRegion: Failed to allocate set bitmap: %d x %d\n" , existing->width , existing->height );
+		FreeImage(&synthesized);
+		if (set) FreeBitmap(&set);
+		free(sources);
+		return NULL;
+	}
+
+	// copy the existing image, marking all pixels but the masked ones as set
+	unsigned int num_masked = 0;
+	for( unsigned int i=0 ; i<existing->height ; i++ ) {
+		for( unsigned int j=0 ; j<existing->width ; j++ ) {
+			unsigned int k = i*existing->width + j;
+			Pixel m = mask->pixels[k];
+			PixelIndex idx = { j, i };
+			synthesized->pixels[k] = existing->pixels[k];
+			if (m.r > 127 || m.g > 127 || m.b > 127) {
+				// unset pixels are shown in grey when verbose, as in SynthesizeFromExemplar
+				if (verbose) {
+					synthesized->pixels[k].r = synthesized->pixels[k].g = synthesized->pixels[k].b = 50;
+				}
+				num_masked++;
+			}
+			else {
+				SetBit(set, idx);
+			}
+		}
+	}
+
+	// at least one pixel has to remain set to provide context for the growth
+	if (num_masked == existing->width*existing->height) {
+		fprintf( stderr , "[ERROR] ResynthesizeRegion: Mask selects every pixel of the image\n" );
+		FreeImage(&synthesized);
+		FreeBitmap(&set);
+		free(sources);
+		return NULL;
+	}
+	if (verbose) {
+		printf("Resynthesizing %d of %d pixels\n", num_masked, existing->width*existing->height);
+	}
+
+	synthesizeTexture(synthesized, set, sources, exemplar, windowRadius, options);
 
+	FreeBitmap(&set);
+	free(sources);
 	return synthesized;
 }
 
-// Takes a pointer to the old pixel and the new pixel itself
-// Sets the old pixel to the new pixel
-void setPixel(Pixel * old_color, const Pixel new_color){
+// Places a randomly chosen crop of the exemplar in the middle of every cell of a
+// grid x grid partition of the output, skipping cells that overlap the exemplar copy
+// in the top-left corner. The crops are half the size of the exemplar (but at least
+// a full window, and no larger than a cell) and record the exemplar pixels they come
+// from, so that each of them starts an independent front.
+void placeSeedPatches(Image *synthesized, Bitmap *set, PixelIndex *sources, const Image *exemplar,
+						unsigned int windowRadius, unsigned int grid) {
+	unsigned int cellWidth = synthesized->width / grid;
+	unsigned int cellHeight = synthesized->height / grid;
+	unsigned int cropWidth = exemplar->width / 2 > 2*windowRadius + 1 ? exemplar->width / 2 : 2*windowRadius + 1;
+	unsigned int cropHeight = exemplar->height / 2 > 2*windowRadius + 1 ? exemplar->height / 2 : 2*windowRadius + 1;
+	if (cropWidth > exemplar->width) cropWidth = exemplar->width;
+	if (cropHeight > exemplar->height) cropHeight = exemplar->height;
+	if (cropWidth > cellWidth) cropWidth = cellWidth;
+	if (cropHeight > cellHeight) cropHeight = cellHeight;
+	if (cropWidth == 0 || cropHeight == 0) {
+		return;
+	}
+
+	for (unsigned int gy = 0; gy < grid; gy++) {
+		for (unsigned int gx = 0; gx < grid; gx++) {
+			unsigned int y0 = gy*cellHeight + (cellHeight - cropHeight) / 2;
+			unsigned int x0 = gx*cellWidth + (cellWidth - cropWidth) / 2;
+			if (x0 < exemplar->width && y0 < exemplar->height) {
+				continue;
+			}
+
+			unsigned int ex_y0 = SynthesisRandom() % (exemplar->height - cropHeight + 1);
+			unsigned int ex_x0 = SynthesisRandom() % (exemplar->width - cropWidth + 1);
+			for (unsigned int i = 0; i < cropHeight; i++) {
+				for (unsigned int j = 0; j < cropWidth; j++) {
+					PixelIndex img_idx = { x0 + j, y0 + i };
+					setPixel(synthesized, set, img_idx, exemplar->pixels[(ex_y0 + i)*exemplar->width + ex_x0 + j]);
+					sources[img_idx.y*synthesized->width + img_idx.x].x = ex_x0 + j;
+					sources[img_idx.y*synthesized->width + img_idx.x].y = ex_y0 + i;
+				}
+			}
+		}
+	}
+}
+
+// Allocates the array storing, for each pixel of an image, the exemplar pixel it
+// was copied from, with all the sources unknown. Returns NULL on failure.
+PixelIndex *createSourceMap(unsigned int width, unsigned int height) {
+	PixelIndex *sources = malloc(sizeof(PixelIndex) * width * height);
+	if (sources == NULL) {
+		return NULL;
+	}
+	for (unsigned int i = 0; i < width * height; i++) {
+		sources[i].x = sources[i].y = INVALID_PIXEL_COORD;
+	}
+	return sources;
+}
+
+// Takes the synthesized image, the bitmap of set pixels, the index of the pixel
+// and the new color. Sets the pixel to the new color and marks it as set
+void setPixel(Image *synthesized, Bitmap *set, PixelIndex idx, const Pixel new_color){
 
 	// breaks if the old pixel is already set
-	assert(!(old_color->a == 255));
+	assert(!IsBitSet(set, idx));
 
 	// sets the old pixel's colors to the new pixel's colors
+	Pixel *old_color = GetPixel(synthesized, idx);
 	old_color->r = new_color.r;
 	old_color->g = new_color.g;
 	old_color->b = new_color.b;
-	old_color->a = 255;
+	SetBit(set, idx);
 	
 }
 
-// Takes in a pointer to the image to be synthesized, the width of the output image, the height
-// of the output image, and an int pointer to size (which will later be set to the size of the
-// TBSPixel array). Finds all the to-be-set pixels and adds and returns them in an array.
-TBSPixel *findTBSPixel(Image *synthesized, unsigned int Width , unsigned int Height, int* size) {
+// Takes in the bitmap of set pixels, the corners of the region to search (min inclusive,
+// max exclusive) and an int pointer to size (which will later be set to the size of the
+// TBSPixel array). Finds all the to-be-set pixels in the region and adds and returns them
+// in an array. The neighbor counts of 64 pixels are computed at once from the bitmap.
+TBSPixel *findTBSPixel(const Bitmap *set, PixelIndex regionMin, PixelIndex regionMax, int* size) {
 	
 	// dynamically allocate array
-	TBSPixel* TBSPixelArr = malloc(sizeof(TBSPixel) * Width * Height);
+	TBSPixel* TBSPixelArr = malloc(sizeof(TBSPixel) * (regionMax.x - regionMin.x) * (regionMax.y - regionMin.y) + sizeof(TBSPixel));
 
 	// keeps track of size of TBSPixelArr
 	int counter = 0;
 
-	// for every pixel in the synthesized image
-	for(unsigned int i=0 ; i<(unsigned int) (Height) ; i++) {
+	// for every word of every row in the region of the synthesized image
+	for(unsigned int i=regionMin.y ; i<regionMax.y ; i++) {
 		
-		for (unsigned int j=0 ; j<(unsigned int) (Width) ; j++) {
-			
-			if(synthesized->pixels[i*Width + j].a != 255){
-				
-				// Find pixel index and store in in struct
-				TBSPixelArr[counter].idx.x = j;
-				TBSPixelArr[counter].idx.y = i;
-				
-				// Check how many pixels up down left right and diagonals
-				int neighborCount = findNumNeigbhors(synthesized, (i*Width+j), Width, Height);
-				
-				// only add the TBSPixel to the array if the neighbour count is not 0
-				if (neighborCount != 0) {
-					TBSPixelArr[counter].neighborCount = neighborCount;
-					
+		for (unsigned int w=regionMin.x/64 ; w<=(regionMax.x-1)/64 ; w++) {
+
+			// bits of the word that lie inside the region
+			unsigned int first = w*64 > regionMin.x ? 0 : regionMin.x - w*64;
+			unsigned int last = (w+1)*64 < regionMax.x ? 64 : regionMax.x - w*64;
+			uint64_t inRegion = (last == 64 ? ~(uint64_t)0 : ((uint64_t)1 << last) - 1) & ~(((uint64_t)1 << first) - 1);
+
+			// only unset pixels with a neighbour count that is not 0 are added to the array
+			uint64_t planes[4];
+			CountNeighborBits(set, i, w, planes);
+			uint64_t tbs = ~set->words[i*set->wordsPerRow + w] & (planes[0] | planes[1] | planes[2] | planes[3]) & inRegion;
+			if (tbs == 0) {
+				continue;
+			}
+
+			for (unsigned int b = first; b < last; b++) {
+				if ((tbs >> b) & 1) {
+					// Find pixel index and store in in struct
+					TBSPixelArr[counter].idx.x = w*64 + b;
+					TBSPixelArr[counter].idx.y = i;
+					TBSPixelArr[counter].neighborCount = ((planes[0] >> b) & 1) | (((planes[1] >> b) & 1) << 1) |
+															(((planes[2] >> b) & 1) << 2) | (((planes[3] >> b) & 1) << 3);
+
 					// Assign random number
-					TBSPixelArr[counter].r = rand();
+					TBSPixelArr[counter].r = SynthesisRandom();
 					counter++;
 				}
-
-		
 			}
 		}
 	}
@@ -169,187 +459,693 @@ TBSPixel *findTBSPixel(Image *synthesized, unsigned int Width , unsigned int Hei
 
 }
 
-// Checks if index of a pixel in the 1-D form is in bounds
-int checkIndexInBound(int index, unsigned int Width, unsigned int Height) {
-	if (index >= 0 && index <= (int)(Width * Height - 1)){
-		return 1;
+// Synthesizes the texture of all the TBS Pixels in the output image
+// Takes in the image to be synthesized, the bitmap of its set pixels, the exemplar sources of
+// its pixels, the exemplar image, the window radius and the options (used for checkpointing,
+// batching and the candidate budget). Only the bounding box of the
+// pixels that are unset at the start is searched for TBS pixels, so the cost of filling
+// in a small region scales with the size of the region rather than the image.
+void synthesizeTexture(Image *synthesized , Bitmap *set , PixelIndex *sources , const Image *exemplar , unsigned int windowRadius, const SynthesisOptions *options) {
+	
+	unsigned int synWidth = synthesized->width;
+	unsigned int synHeight = synthesized->height;
+	int num_tbs_pixels = 0;
+
+	// number of pixels set since the last checkpoint
+	unsigned int pixels_since_checkpoint = 0;
+	CheckpointHeader header = { exemplar->width, exemplar->height, windowRadius, options->batchSize, options->candidateBudget,
+								options->seedGrid, options->palette ? 1 : 0, 0 };
+
+	// number of unset pixels in each row, used to report rows as they are completed
+	unsigned int *unset_per_row = calloc(synHeight, sizeof(unsigned int));
+	if (unset_per_row == NULL) {
+		fprintf( stderr , "[ERROR] Failed to allocate row counts: %d\n" , synHeight );
+		return;
 	}
-	else {
-		return 0;
+
+	// finds the bounding box of the unset pixels
+	PixelIndex regionMin = { synWidth, synHeight };
+	PixelIndex regionMax = { 0, 0 };
+	for (unsigned int i = 0; i < synHeight; i++) {
+		unset_per_row[i] = synWidth - CountRowBits(set, i);
+		for (unsigned int j = 0; j < synWidth && unset_per_row[i] > 0; j++) {
+			PixelIndex idx = { j, i };
+			if (!IsBitSet(set, idx)) {
+				if (j < regionMin.x) regionMin.x = j;
+				if (i < regionMin.y) regionMin.y = i;
+				if (j + 1 > regionMax.x) regionMax.x = j + 1;
+				if (i + 1 > regionMax.y) regionMax.y = i + 1;
+			}
+		}
+	}
+
+	// reports the rows that are already complete
+	unsigned int completed_rows = 0;
+	while (completed_rows < synHeight && unset_per_row[completed_rows] == 0) {
+		completed_rows++;
+	}
+	if (options->rowsCompleted != NULL) {
+		options->rowsCompleted(synthesized, completed_rows, options->rowsCompletedData);
+	}
+
+	// nothing to synthesize
+	if (regionMax.x == 0) {
+		free(unset_per_row);
+		return;
+	}
+
+	// the Gaussian weights only depend on the radius, so they are computed once, and the
+	// exemplar is packed for matching unless the caller already did so
+	unsigned int *weights = createGaussWeights(windowRadius);
+	PackedExemplar *owned_packed = NULL;
+	if (options->packedExemplar == NULL) {
+		owned_packed = options->palette ? PackExemplarWithPalette(exemplar) : PackExemplar(exemplar);
+	}
+	const PackedExemplar *packed = options->packedExemplar != NULL ? options->packedExemplar : owned_packed;
+	if (weights == NULL || packed == NULL) {
+		free(unset_per_row);
+		free(weights);
+		if (owned_packed) FreePackedExemplar(&owned_packed);
+		return;
+	}
+
+	// Creates inital array of TBS pixels
+	TBSPixel * TBSPixelArr = findTBSPixel(set, regionMin, regionMax, &num_tbs_pixels);
+
+	// Iterates while there are still pixels to-be-set
+	while (num_tbs_pixels > 0) { 
+		// sorts TBS array
+		SortTBSPixels(TBSPixelArr, num_tbs_pixels);
+		
+		// synthesizes the pixel at the first index of TBSPixelArr (has the most neighbors since sorted),
+		// together with up to batchSize-1 of the next pixels whose windows are disjoint from it
+		unsigned int num_selected = 1;
+		if (options->batchSize > 1) {
+			num_selected = selectIndependentTBSPixels(TBSPixelArr, num_tbs_pixels, options->batchSize, windowRadius);
+		}
+		synthesizePixels(TBSPixelArr, num_selected, synthesized, set, sources, exemplar, packed, weights, windowRadius, options->candidateBudget);
+
+		// reports the leading rows that are now complete
+		unsigned int old_completed_rows = completed_rows;
+		for (unsigned int n = 0; n < num_selected; n++) {
+			unset_per_row[TBSPixelArr[n].idx.y]--;
+		}
+		while (completed_rows < synHeight && unset_per_row[completed_rows] == 0) {
+			completed_rows++;
+		}
+		if (options->rowsCompleted != NULL && completed_rows > old_completed_rows) {
+			options->rowsCompleted(synthesized, completed_rows, options->rowsCompletedData);
+		}
+
+		free(TBSPixelArr);
+
+		// periodically saves the state; it is taken before the next frontier is computed so that
+		// a resumed run draws exactly the same random numbers as an uninterrupted one
+		pixels_since_checkpoint += num_selected;
+		if (options->checkpointPath != NULL && pixels_since_checkpoint >= options->checkpointInterval) {
+			header.randState = GetSynthesisRandomState();
+			WriteCheckpoint(options->checkpointPath, synthesized, set, sources, &header);
+			pixels_since_checkpoint = 0;
+		}
+
+		// creates a new TBS pixel array taking into account the pixel that was just set
+		TBSPixelArr = findTBSPixel(set, regionMin, regionMax, &num_tbs_pixels);
 	}
+
+	free(TBSPixelArr);
+	free(unset_per_row);
+	free(weights);
+	if (owned_packed) FreePackedExemplar(&owned_packed);
+	
 }
 
-// Finds the number of neighbours of a TBSPixel given the
-// image to be synthesized, the pixel's index, the output image
-// width, and height
-int findNumNeigbhors(Image *synthesized, int index, unsigned int Width, unsigned int Height) {
-	int counter = 0;
+
+// Synthesizes the first numPixels pixels of a TBSPixel array, whose windows must not
+// contain each other's pixels, so that all of them can be matched in a single pass over
+// the exemplar. Takes the TBSPixel array, the number of pixels, the output image, the bitmap
+// of its set pixels, their exemplar sources, the source exemplar image, the packed exemplar,
+// the Gaussian weights, the radius and the candidate budget. If the budget is not 0 and smaller than the number of valid
+// candidates, only a stratified sample of that many exemplar pixels plus the pixels continuing
+// the sources of the set neighbors are scored, instead of the whole exemplar.
+void synthesizePixels(TBSPixel* TBSPixelArr, unsigned int numPixels, Image *synthesized , Bitmap *set , PixelIndex *sources , const Image *source ,
+						const PackedExemplar *exemplar , const unsigned int *weights, unsigned int windowRadius, unsigned int candidateBudget) {
 	
-	// Up
-	if (checkIndexInBound(index - Width, Width, Height)) {
-		if(synthesized->pixels[index-Width].a == 255) {
-			counter++;
-		}
+	int exWidth = exemplar->width;
+	int exHeight = exemplar->height;
+	unsigned int channels = exemplar->channels;
+	unsigned int windowSize = 2*windowRadius + 1;
+	unsigned int maxTaps = windowSize*windowSize;
+
+	// a sampled search scores at most the budget plus the coherent candidates of the 8 neighbors
+	unsigned int maxCandidates = exHeight * exWidth;
+	if (candidateBudget != 0 && candidateBudget < maxCandidates) {
+		maxCandidates = candidateBudget;
 	}
 
-	// Down
-	if (checkIndexInBound(index + Width, Width, Height)) {
-		if(synthesized->pixels[index+Width].a == 255) {
-			counter++;
-		}
+	// space for the packed queries and, for each of them, the array of Exemplar pixels
+	// that are elligible candidates for the TBS pixel
+	WindowQuery *queries = malloc(sizeof(WindowQuery) * numPixels);
+	int *tapOffsets = malloc(sizeof(int) * maxTaps * numPixels);
+	unsigned int *tapWeights = malloc(sizeof(unsigned int) * maxTaps * numPixels);
+	unsigned char *tapValues = malloc(maxTaps * channels * numPixels);
+	EXPPixel **EXPPixelArrs = malloc(sizeof(EXPPixel*) * numPixels);
+	int *counters = malloc(sizeof(int) * numPixels);
+	if (!queries || !tapOffsets || !tapWeights || !tapValues || !EXPPixelArrs || !counters) {
+		fprintf( stderr , "[ERROR] Failed to allocate queries: %d\n" , numPixels );
+		exit(1);
 	}
 
-	// Left
-	if (checkIndexInBound(index - 1, Width, Height)) {
-		if(synthesized->pixels[index-1].a == 255) {
-			counter++;
+	for (unsigned int n = 0; n < numPixels; n++) {
+		// set a 2D array of pixel pointers around the TBS pixel
+		const Pixel* tbsPixelWindow[windowSize][windowSize];
+		createPixelWindow(tbsPixelWindow[0], synthesized, set, windowRadius, TBSPixelArr[n].idx.y, TBSPixelArr[n].idx.x);
+
+		// packs the set pixels of the window into a query so that candidates can be scored
+		// directly against the exemplar without building a window for each of them
+		queries[n].offsets = tapOffsets + n*maxTaps;
+		queries[n].weights = tapWeights + n*maxTaps;
+		queries[n].values = tapValues + n*maxTaps*channels;
+		createWindowQuery(&queries[n], tbsPixelWindow[0], weights, windowRadius, exemplar);
+
+		EXPPixelArrs[n] = malloc(sizeof(EXPPixel) * (maxCandidates + 8));
+		if (EXPPixelArrs[n] == NULL) {
+			fprintf( stderr , "[ERROR] Failed to allocate candidates: %d x %d\n" , exWidth , exHeight );
+			exit(1);
 		}
 	}
 
-	// Right
-	if (((index+1)%Width != 0) && checkIndexInBound(index + 1, Width, Height)) {
-		if(synthesized->pixels[index+1].a == 255) {
-			counter++;
+	// Selecting best pixel in the exemplar for all the queries at once
+	if (candidateBudget == 0) {
+		scoreWindowQueries(queries, numPixels, exemplar, EXPPixelArrs, counters);
+	}
+	else {
+		for (unsigned int n = 0; n < numPixels; n++) {
+			// the exemplar pixels that continue the patches the set neighbors were copied from
+			PixelIndex coherent[8];
+			unsigned int numCoherent = 0;
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dx = -1; dx <= 1; dx++) {
+					PixelIndex neighbor = { TBSPixelArr[n].idx.x + dx, TBSPixelArr[n].idx.y + dy };
+					if ((dx == 0 && dy == 0) || !IsBitSet(set, neighbor)) {
+						continue;
+					}
+					PixelIndex source = sources[neighbor.y * synthesized->width + neighbor.x];
+					if (source.x != INVALID_PIXEL_COORD) {
+						coherent[numCoherent].x = source.x - dx;
+						coherent[numCoherent].y = source.y - dy;
+						numCoherent++;
+					}
+				}
+			}
+			counters[n] = scoreWindowQuerySampled(&queries[n], exemplar, coherent, numCoherent, candidateBudget, EXPPixelArrs[n]);
 		}
 	}
 
-	// NE
-	if (((index+1)%Width != 0) && checkIndexInBound(index - Width + 1, Width, Height)) {
-		if(synthesized->pixels[index-Width + 1].a == 255) {
-			counter++;
-		}
+	for (unsigned int n = 0; n < numPixels; n++) {
+		// finding the best exemplar pixel, e.g. the one to set the TBS pixel to
+		EXPPixel BestPixel = findBestExemplarPix(EXPPixelArrs[n], counters[n]);
+	
+		// setting the pixel 
+		// the packed values are only used for matching: a palette index would lose the original color
+		Pixel new_pixel = source->pixels[BestPixel.idx.y*exWidth + BestPixel.idx.x];
+		new_pixel.a = 255;
+		setPixel(synthesized, set, TBSPixelArr[n].idx, new_pixel);
+		sources[TBSPixelArr[n].idx.y * synthesized->width + TBSPixelArr[n].idx.x] = BestPixel.idx;
+		free(EXPPixelArrs[n]);
 	}
 
-	// NW
-	if (checkIndexInBound(index - Width - 1, Width, Height)) {
-		if(synthesized->pixels[index-Width-1].a == 255) {
-			counter++;
-		}
+	free(queries);
+	free(tapOffsets);
+	free(tapWeights);
+	free(tapValues);
+	free(EXPPixelArrs);
+	free(counters);
+}
+
+// Scores several queries against the exemplar. The exemplar is processed in bands of rows
+// small enough to stay in cache, and every query is evaluated against a band before moving
+// on to the next one, so each exemplar row is fetched from memory once per batch rather than
+// once per query. Candidates are stored row by row, in the same order as a plain scan.
+// Takes the queries, their number, the packed exemplar, and for each query an array for
+// its candidates and the place to store their number
+void scoreWindowQueries(const WindowQuery *queries, unsigned int numQueries, const PackedExemplar *exemplar,
+						EXPPixel **EXPPixelArrs, int *counters) {
+
+	int exWidth = exemplar->width;
+	int exHeight = exemplar->height;
+	unsigned int channels = exemplar->channels;
+
+	// the rows read by a band of candidates extend past it by the largest extent of the queries
+	int reach = 0;
+	for (unsigned int n = 0; n < numQueries; n++) {
+		counters[n] = 0;
+		if (-queries[n].minRow > reach) reach = -queries[n].minRow;
+		if (queries[n].maxRow > reach) reach = queries[n].maxRow;
+	}
+	int rowBytes = exWidth * channels;
+	int bandRows = MATCH_TILE_BYTES / rowBytes - 2*reach;
+	if (bandRows < 1) {
+		bandRows = 1;
 	}
 
-	// SE
-	if (((index+1)%Width != 0) && checkIndexInBound(index + Width + 1, Width, Height)) {
-		if(synthesized->pixels[index+Width+1].a == 255) {
-			counter++;
+	for (int bandStart = 0; bandStart < exHeight; bandStart += bandRows) {
+		int bandEnd = bandStart + bandRows < exHeight ? bandStart + bandRows : exHeight;
+
+		for (unsigned int n = 0; n < numQueries; n++) {
+			const WindowQuery *query = &queries[n];
+			EXPPixel *EXPPixelArr = EXPPixelArrs[n];
+			int counter = counters[n];
+
+			// An exemplar pixel is a valid candidate if every set pixel of the TBS window
+			// falls inside the exemplar when the window is centered on it
+			int rowStart = bandStart > -query->minRow ? bandStart : -query->minRow;
+			int rowEnd = bandEnd < exHeight - query->maxRow ? bandEnd : exHeight - query->maxRow;
+			for (int i = rowStart; i < rowEnd; i++) {
+				for(int j = -query->minCol; j < exWidth - query->maxCol; j++) {
+					EXPPixelArr[counter].idx.x = j;
+					EXPPixelArr[counter].idx.y = i;
+					EXPPixelArr[counter].GaussScore = findGaussScore(query, exemplar->values + (i*exWidth + j)*channels, channels);
+					counter++;
+				}
+			}
+			counters[n] = counter;
 		}
 	}
+}
 
-	// SW
-	if (checkIndexInBound(index + Width - 1, Width, Height)) {
-		if(synthesized->pixels[index+Width-1].a == 255) {
-			counter++;
+// Scores a sample of the valid exemplar candidates of a query: the given coherent candidates
+// (those outside the valid range or repeated are skipped) followed by a stratified random
+// sample of budget candidates, one from each of budget equal slices of the valid range in
+// row-major order. If the budget covers the valid range, every candidate is scored instead.
+// Takes the query, the packed exemplar, the coherent candidates, their number, the budget and
+// the array for the candidates (which must hold budget+numCoherent entries). Returns the
+// number of candidates stored
+int scoreWindowQuerySampled(const WindowQuery *query, const PackedExemplar *exemplar, const PixelIndex *coherent,
+						unsigned int numCoherent, unsigned int budget, EXPPixel *EXPPixelArr) {
+
+	int exWidth = exemplar->width;
+	int exHeight = exemplar->height;
+	unsigned int channels = exemplar->channels;
+
+	// valid range of candidate centers
+	int rowStart = -query->minRow, rowEnd = exHeight - query->maxRow;
+	int colStart = -query->minCol, colEnd = exWidth - query->maxCol;
+	if (rowEnd <= rowStart || colEnd <= colStart) {
+		return 0;
+	}
+	unsigned long long numCols = colEnd - colStart;
+	unsigned long long numValid = (rowEnd - rowStart) * numCols;
+	if (budget >= numValid) {
+		int counter = 0;
+		scoreWindowQueries(query, 1, exemplar, &EXPPixelArr, &counter);
+		return counter;
+	}
+
+	int counter = 0;
+	for (unsigned int c = 0; c < numCoherent; c++) {
+		int i = coherent[c].y, j = coherent[c].x;
+		bool repeated = false;
+		for (unsigned int d = 0; d < c && !repeated; d++) {
+			repeated = coherent[d].x == coherent[c].x && coherent[d].y == coherent[c].y;
+		}
+		if (repeated || i < rowStart || i >= rowEnd || j < colStart || j >= colEnd) {
+			continue;
 		}
+		EXPPixelArr[counter].idx = coherent[c];
+		EXPPixelArr[counter].GaussScore = findGaussScore(query, exemplar->values + (i*exWidth + j)*channels, channels);
+		counter++;
 	}
 
-	return counter;
+	for (unsigned int s = 0; s < budget; s++) {
+		unsigned long long first = s * numValid / budget;
+		unsigned long long last = (s + 1) * numValid / budget;
+		unsigned long long k = first + SynthesisRandom() % (last - first);
+		int i = rowStart + (int)(k / numCols);
+		int j = colStart + (int)(k % numCols);
+		EXPPixelArr[counter].idx.x = j;
+		EXPPixelArr[counter].idx.y = i;
+		EXPPixelArr[counter].GaussScore = findGaussScore(query, exemplar->values + (i*exWidth + j)*channels, channels);
+		counter++;
+	}
 
+	return counter;
 }
 
-// Synthesizes the texture of all the TBS Pixels in the output image
-// Takes in the image to be synthesized, the exemplar image width, the
-// exemplar image height, the output image width, the output image height,
-// and the window radius
-void synthesizeTexture(Image *synthesized , unsigned int exWidth , unsigned int exHeight , 
-						unsigned int synWidth, unsigned int synHeight, unsigned int windowRadius) {
-	
-	int num_tbs_pixels = 0;
+// Moves up to maxPixels pixels from the front of a sorted TBSPixel array to its start, such
+// that no two of them are within 2*windowRadius of each other (so their windows are disjoint
+// and they can be synthesized independently). The first pixel is always selected. Returns
+// the number of selected pixels
+unsigned int selectIndependentTBSPixels(TBSPixel *TBSPixelArr, unsigned int size, unsigned int maxPixels, unsigned int windowRadius) {
+	unsigned int selected = 0;
+	int minDistance = 2*windowRadius;
+
+	for (unsigned int i = 0; i < size && selected < maxPixels; i++) {
+		bool independent = true;
+		for (unsigned int n = 0; n < selected && independent; n++) {
+			int dx = abs((int)TBSPixelArr[i].idx.x - (int)TBSPixelArr[n].idx.x);
+			int dy = abs((int)TBSPixelArr[i].idx.y - (int)TBSPixelArr[n].idx.y);
+			independent = dx > minDistance || dy > minDistance;
+		}
+		if (independent) {
+			TBSPixel tmp = TBSPixelArr[selected];
+			TBSPixelArr[selected] = TBSPixelArr[i];
+			TBSPixelArr[i] = tmp;
+			selected++;
+		}
+	}
 
-	// Creates inital array of TBS pixels
-	TBSPixel * TBSPixelArr = findTBSPixel(synthesized, synWidth, synHeight, &num_tbs_pixels);
+	return selected;
+}
 
-	// Iterates while there are still pixels to-be-set
-	while (num_tbs_pixels > 0) { 
-		// sorts TBS array
-		SortTBSPixels(TBSPixelArr, num_tbs_pixels);
-		
-		// synthesizes the pixel at the first index of TBSPixelArr (has the most neighbors since sorted)
-		synthesizePixel(TBSPixelArr, synthesized, exWidth, exHeight, synWidth, synHeight, windowRadius);
+// Packs the set pixels of a TBS pixel window into a query
+// Takes in the query (whose arrays must hold a full window), the pixel window, the
+// Gaussian weights, the window radius, and the width and channel count of the packed exemplar
+void createWindowQuery(WindowQuery *query, const Pixel** PixelWindow, const unsigned int *weights,
+						unsigned int windowRadius, const PackedExemplar *exemplar) {
+
+	int radius = windowRadius;
+	int exWidth = exemplar->width;
+	unsigned int channels = exemplar->channels;
+	query->numTaps = 0;
+	query->paletteDistances = exemplar->paletteDistances;
+	query->paletteSize = exemplar->paletteSize;
+
+	// the extent always includes the center, since the candidate itself has to be an exemplar pixel
+	query->minRow = query->minCol = 0;
+	query->maxRow = query->maxCol = 0;
+
+	for(int h = -radius; h <= radius; h++) {
+		for(int k = -radius; k <= radius; k++) {
+			unsigned int w = (h + radius)*(2*radius + 1) + (k + radius);
+			const Pixel *p = PixelWindow[w];
+			if (p == NULL) {
+				continue;
+			}
 
-		free(TBSPixelArr);
+			// keeps track of the extent of the set pixels
+			if (h < query->minRow) query->minRow = h;
+			if (h > query->maxRow) query->maxRow = h;
+			if (k < query->minCol) query->minCol = k;
+			if (k > query->maxCol) query->maxCol = k;
+
+			unsigned int t = query->numTaps++;
+			query->offsets[t] = (h*exWidth + k) * (int)channels;
+			query->weights[t] = weights[w];
+			if (exemplar->palette != NULL) {
+				query->values[t] = findPaletteIndex(exemplar, *p);
+			}
+			else if (channels == 1) {
+				query->values[t] = p->r;
+			}
+			else {
+				query->values[3*t+0] = p->r;
+				query->values[3*t+1] = p->g;
+				query->values[3*t+2] = p->b;
+			}
+		}
+	}
+}
 
-		// creates a new TBS pixel array taking into account the pixel that was just set
-		TBSPixelArr = findTBSPixel(synthesized, synWidth, synHeight, &num_tbs_pixels);
+// Packs the colors of an exemplar into the layout used for matching: one byte per
+// pixel for grayscale exemplars and three for color ones. Returns NULL on failure.
+PackedExemplar *PackExemplar(const Image *exemplar) {
+	PackedExemplar *packed = malloc(sizeof(PackedExemplar));
+	if (packed == NULL) {
+		return NULL;
+	}
+	packed->width = exemplar->width;
+	packed->height = exemplar->height;
+	packed->channels = exemplar->channels == 1 ? 1 : 3;
+	packed->palette = NULL;
+	packed->paletteSize = 0;
+	packed->paletteDistances = NULL;
+	packed->colorTableSize = 0;
+	packed->colorKeys = NULL;
+	packed->colorIndices = NULL;
+	packed->values = malloc(exemplar->width * exemplar->height * packed->channels);
+	if (packed->values == NULL) {
+		fprintf( stderr , "[ERROR] PackExemplar: Failed to allocate exemplar: %d x %d\n" , exemplar->width , exemplar->height );
+		free(packed);
+		return NULL;
 	}
 
-	free(TBSPixelArr);					
-	
+	for (unsigned int i = 0; i < exemplar->width * exemplar->height; i++) {
+		Pixel p = exemplar->pixels[i];
+		if (packed->channels == 1) {
+			packed->values[i] = p.r;
+		}
+		else {
+			packed->values[3*i+0] = p.r;
+			packed->values[3*i+1] = p.g;
+			packed->values[3*i+2] = p.b;
+		}
+	}
+	return packed;
 }
 
+// Frees a packed exemplar
+void FreePackedExemplar(PackedExemplar **packed) {
+	free((*packed)->values);
+	free((*packed)->palette);
+	free((*packed)->paletteDistances);
+	free((*packed)->colorKeys);
+	free((*packed)->colorIndices);
+	free(*packed);
+	*packed = NULL;
+}
 
-// Synthesizes a pixel based on the exemplar and already set pixels
-// takes a TBSPixel array, the output image + associated dimensions, the exemplar dimensions and the radius
-void synthesizePixel(TBSPixel* TBSPixelArr, Image *synthesized , unsigned int exWidth , unsigned int exHeight , 
-						unsigned int synWidth, unsigned int synHeight, unsigned int windowRadius) {
-	
+// A distinct color of an exemplar and the number of its pixels with that color
+typedef struct {
+	Pixel color;
+	unsigned int count;
+} PaletteColor;
 
-	// Finds the x and y coordinates of the pixel with the most amount of neighbors
-	unsigned int x_coord = TBSPixelArr->idx.x;
-	unsigned int y_coord = TBSPixelArr->idx.y;
-	
-	// Pointer to pixel with most amount of neighbors
-	Pixel* old_pixel = GetPixel(synthesized, TBSPixelArr->idx);
-	
-	// set a 2D array of pixel pointers around a center pixel which is the first element in the TBSPixelArr (most neighbors)
-	Pixel* tbsPixelWindow[2*windowRadius+1][2*windowRadius+1];
-	tbsPixelWindow[windowRadius][windowRadius] = old_pixel; // set center of window to the to-be-set pixel
-	
-	// Sets the rest of the elments of the pixel window to their corresponding pixel around the center pixel
-	createPixelWindow(tbsPixelWindow[0], synthesized,
-						synWidth, synHeight, synWidth, windowRadius, y_coord, x_coord);
-	
-	
-	//array of Exemplar pixels that are elligible candidates for the TBS pixel
-	EXPPixel* EXPPixelArr = malloc(sizeof(EXPPixel) * exHeight * exWidth);
-	int counter = 0;
+// Comparison functions ordering distinct colors by one channel, for the median cut
+static int comparePaletteColorsR(const void *v1, const void *v2) {
+	return (int)((const PaletteColor *)v1)->color.r - (int)((const PaletteColor *)v2)->color.r;
+}
+static int comparePaletteColorsG(const void *v1, const void *v2) {
+	return (int)((const PaletteColor *)v1)->color.g - (int)((const PaletteColor *)v2)->color.g;
+}
+static int comparePaletteColorsB(const void *v1, const void *v2) {
+	return (int)((const PaletteColor *)v1)->color.b - (int)((const PaletteColor *)v2)->color.b;
+}
 
-	// Selecting best pixel in the exemplar 
-	// Creating a window around every pixel in the exemplar
-	for (int i = 0; i < (int)exHeight; i++) {
-		for(int j = 0; j < (int)exWidth; j++) {
-
-			// setting a 2D array of pixels pointers, or a window, around each pixel in the exemplar 
-			Pixel* expPixelWindow[2*windowRadius+1][2*windowRadius+1];
-			expPixelWindow[windowRadius][windowRadius] = &(synthesized->pixels[i * synWidth + j]); // set center to exemplar pixel to be checked
-
-			// setting the pixels in the window to their corresponding pixel values
-			createPixelWindow(expPixelWindow[0], synthesized, exWidth, exHeight, synWidth, windowRadius, i, j);
-
-			// checks if the exemplar pixel window is a valid comparison to the TBS pixel window
-			// if so, the exemplar pixel is added to the exemplar pixel array and its gaussian is calculated
-			int different = 0;
-			for(unsigned int h = 0; h < 2*windowRadius+1; h++) {
-				for(unsigned int k = 0; k < 2*windowRadius+1; k++) {
-					if(expPixelWindow[h][k] == NULL && tbsPixelWindow[h][k] != NULL) {
-						different++;
-					}
+// Returns the hash table key of a color
+static unsigned int colorKey(Pixel color) {
+	return 0x01000000u | ((unsigned int)color.r << 16) | ((unsigned int)color.g << 8) | color.b;
+}
+
+// Returns the slot of the hash table holding the key, or the empty slot it would go in
+static unsigned int findColorSlot(const unsigned int *keys, unsigned int tableSize, unsigned int key) {
+	unsigned int h = key;
+	h ^= h >> 16;
+	h *= 0x45d9f3bu;
+	h ^= h >> 16;
+	unsigned int slot = h & (tableSize - 1);
+	while (keys[slot] != 0 && keys[slot] != key) {
+		slot = (slot + 1) & (tableSize - 1);
+	}
+	return slot;
+}
+
+// Packs an exemplar as palette indices. The distinct colors of the exemplar are the
+// palette if there are at most MAX_PALETTE_SIZE of them (so the matching is exact), and
+// are otherwise split by median cut into MAX_PALETTE_SIZE boxes, each represented by the
+// mean of its colors weighted by their pixel counts. Returns NULL on failure.
+PackedExemplar *PackExemplarWithPalette(const Image *exemplar) {
+	unsigned int numPixels = exemplar->width * exemplar->height;
+	PackedExemplar *packed = malloc(sizeof(PackedExemplar));
+	if (packed == NULL) {
+		return NULL;
+	}
+	packed->width = exemplar->width;
+	packed->height = exemplar->height;
+	packed->channels = 1;
+	packed->paletteSize = 0;
+	packed->palette = NULL;
+	packed->paletteDistances = NULL;
+	packed->colorTableSize = 0;
+	packed->colorKeys = NULL;
+	packed->colorIndices = NULL;
+
+	// the distinct colors are counted in a temporary table that can hold one per pixel (kept at
+	// most half full); the table kept with the packed exemplar is sized once their number is known
+	unsigned int countTableSize = 1;
+	while (countTableSize < 2*numPixels) {
+		countTableSize *= 2;
+	}
+	packed->values = malloc(numPixels);
+	unsigned int *countKeys = calloc(countTableSize, sizeof(unsigned int));
+	unsigned int *colorIds = malloc(sizeof(unsigned int) * countTableSize);
+	PaletteColor *colors = malloc(sizeof(PaletteColor) * numPixels);
+	if (!packed->values || !countKeys || !colorIds || !colors) {
+		fprintf( stderr , "[ERROR] PackExemplarWithPalette: Failed to allocate exemplar: %d x %d\n" , exemplar->width , exemplar->height );
+		free(countKeys);
+		free(colorIds);
+		free(colors);
+		FreePackedExemplar(&packed);
+		return NULL;
+	}
+
+	// counts the pixels of each distinct color
+	unsigned int numColors = 0;
+	for (unsigned int i = 0; i < numPixels; i++) {
+		unsigned int key = colorKey(exemplar->pixels[i]);
+		unsigned int slot = findColorSlot(countKeys, countTableSize, key);
+		if (countKeys[slot] == 0) {
+			countKeys[slot] = key;
+			colorIds[slot] = numColors;
+			colors[numColors].color = exemplar->pixels[i];
+			colors[numColors].color.a = 255;
+			colors[numColors].count = 0;
+			numColors++;
+		}
+		colors[colorIds[slot]].count++;
+	}
+
+	// splits the colors into boxes [boxStart[b],boxStart[b+1]) of the color array, each time
+	// cutting the box with the widest channel range at the pixel-weighted median of that channel
+	unsigned int boxStart[MAX_PALETTE_SIZE + 1];
+	unsigned int numBoxes = 1;
+	boxStart[0] = 0;
+	boxStart[1] = numColors;
+	while (numColors > MAX_PALETTE_SIZE && numBoxes < MAX_PALETTE_SIZE) {
+		int widestBox = -1, widestChannel = 0, widestRange = 0;
+		for (unsigned int b = 0; b < numBoxes; b++) {
+			int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+			for (unsigned int c = boxStart[b]; c < boxStart[b+1]; c++) {
+				int v[3] = { colors[c].color.r, colors[c].color.g, colors[c].color.b };
+				for (int k = 0; k < 3; k++) {
+					if (v[k] < lo[k]) lo[k] = v[k];
+					if (v[k] > hi[k]) hi[k] = v[k];
 				}
 			}
-			if(different == 0) {
-				EXPPixelArr[counter].idx.x = j;
-				EXPPixelArr[counter].idx.y = i;
-				EXPPixelArr[counter].GaussScore = findGaussScore(tbsPixelWindow[0], expPixelWindow[0], windowRadius);
-				counter++;
+			for (int k = 0; k < 3; k++) {
+				if (hi[k] - lo[k] > widestRange) {
+					widestBox = b;
+					widestChannel = k;
+					widestRange = hi[k] - lo[k];
+				}
 			}
 		}
+		if (widestBox < 0) {
+			break;
+		}
+
+		unsigned int start = boxStart[widestBox], end = boxStart[widestBox+1];
+		int (*compare)(const void *, const void *) = widestChannel == 0 ? comparePaletteColorsR : widestChannel == 1 ? comparePaletteColorsG : comparePaletteColorsB;
+		qsort(colors + start, end - start, sizeof(PaletteColor), compare);
+		unsigned long long total = 0, below = 0;
+		for (unsigned int c = start; c < end; c++) {
+			total += colors[c].count;
+		}
+		unsigned int cut = start + 1;
+		for (; cut < end - 1; cut++) {
+			below += colors[cut-1].count;
+			if (2*below >= total) {
+				break;
+			}
+		}
+
+		for (unsigned int b = numBoxes; b > (unsigned int)widestBox; b--) {
+			boxStart[b+1] = boxStart[b];
+		}
+		boxStart[widestBox+1] = cut;
+		numBoxes++;
 	}
 
-	// finding the best exemplar pixel, e.g. the one to set the TBS pixel to
-	EXPPixel BestPixel = findBestExemplarPix(EXPPixelArr, counter);
-	
-	// setting the pixel 
-	int x_new = BestPixel.idx.x;
-	int y_new = BestPixel.idx.y;
-	Pixel new_pixel = synthesized->pixels[y_new * synWidth + x_new];
-	free(EXPPixelArr);
-	setPixel(old_pixel, new_pixel);
+	// each box becomes a palette color, and its colors map to it in a table that holds every
+	// exemplar and palette color and is kept at most half full
+	free(countKeys);
+	free(colorIds);
+	if (numColors <= MAX_PALETTE_SIZE) {
+		numBoxes = numColors;
+		for (unsigned int b = 0; b <= numBoxes; b++) {
+			boxStart[b] = b;
+		}
+	}
+	packed->paletteSize = numBoxes;
+	packed->colorTableSize = 1;
+	while (packed->colorTableSize < 2*(numColors + numBoxes)) {
+		packed->colorTableSize *= 2;
+	}
+	packed->palette = malloc(sizeof(Pixel) * numBoxes);
+	packed->paletteDistances = malloc(sizeof(unsigned int) * numBoxes * numBoxes);
+	packed->colorKeys = calloc(packed->colorTableSize, sizeof(unsigned int));
+	packed->colorIndices = malloc(packed->colorTableSize);
+	if (!packed->palette || !packed->paletteDistances || !packed->colorKeys || !packed->colorIndices) {
+		fprintf( stderr , "[ERROR] PackExemplarWithPalette: Failed to allocate palette: %d colors\n" , numBoxes );
+		free(colors);
+		FreePackedExemplar(&packed);
+		return NULL;
+	}
+	for (unsigned int b = 0; b < numBoxes; b++) {
+		unsigned long long sum[3] = { 0, 0, 0 }, count = 0;
+		for (unsigned int c = boxStart[b]; c < boxStart[b+1]; c++) {
+			sum[0] += (unsigned long long)colors[c].color.r * colors[c].count;
+			sum[1] += (unsigned long long)colors[c].color.g * colors[c].count;
+			sum[2] += (unsigned long long)colors[c].color.b * colors[c].count;
+			count += colors[c].count;
+			unsigned int key = colorKey(colors[c].color);
+			unsigned int slot = findColorSlot(packed->colorKeys, packed->colorTableSize, key);
+			packed->colorKeys[slot] = key;
+			packed->colorIndices[slot] = b;
+		}
+		packed->palette[b].r = (sum[0] + count/2) / count;
+		packed->palette[b].g = (sum[1] + count/2) / count;
+		packed->palette[b].b = (sum[2] + count/2) / count;
+		packed->palette[b].a = 255;
+	}
 
+	// the palette colors themselves (which synthesized pixels are set to) map to their own entries
+	for (unsigned int b = 0; b < numBoxes; b++) {
+		unsigned int key = colorKey(packed->palette[b]);
+		unsigned int slot = findColorSlot(packed->colorKeys, packed->colorTableSize, key);
+		packed->colorKeys[slot] = key;
+		packed->colorIndices[slot] = b;
+	}
+
+	for (unsigned int i = 0; i < numPixels; i++) {
+		packed->values[i] = packed->colorIndices[findColorSlot(packed->colorKeys, packed->colorTableSize, colorKey(exemplar->pixels[i]))];
+	}
+	for (unsigned int b1 = 0; b1 < numBoxes; b1++) {
+		for (unsigned int b2 = 0; b2 < numBoxes; b2++) {
+			packed->paletteDistances[b1*numBoxes + b2] = PixelSquaredDifference(packed->palette[b1], packed->palette[b2]);
+		}
+	}
+
+	free(colors);
+	return packed;
+}
+
+// Returns the index of the palette color closest to the given color: colors of the exemplar
+// and of the palette are looked up in the color table, and any other color is compared
+// against every palette color
+unsigned char findPaletteIndex(const PackedExemplar *exemplar, Pixel color) {
+	unsigned int slot = findColorSlot(exemplar->colorKeys, exemplar->colorTableSize, colorKey(color));
+	if (exemplar->colorKeys[slot] != 0) {
+		return exemplar->colorIndices[slot];
+	}
+
+	unsigned int best = 0;
+	for (unsigned int b = 1; b < exemplar->paletteSize; b++) {
+		if (PixelSquaredDifference(color, exemplar->palette[b]) < PixelSquaredDifference(color, exemplar->palette[best])) {
+			best = b;
+		}
+	}
+	return (unsigned char)best;
 }
 
 // Assigns the pixel values to the pixels in the window around the center pixel
-// Takes in the pixel window, the synthesized image, the width, the height, the synthesized
-// image width, the window radius, and the x and y coordinates of the center pixel
-void createPixelWindow(Pixel** PixelWindow, Image *synthesized , unsigned int width , unsigned int height, unsigned int synWidth,
-						 unsigned int windowRadius, int centerPix_y_coord, int centerPix_x_coord) {
+// Takes in the pixel window, the image the window is taken from, the bitmap of its set
+// pixels (NULL if all pixels are set), the window radius, and the x and y coordinates of
+// the center pixel
+void createPixelWindow(const Pixel** PixelWindow, const Image *image , const Bitmap *set , unsigned int windowRadius,
+						 int centerPix_y_coord, int centerPix_x_coord) {
+
+	int width = image->width;
+	int height = image->height;
 
 	for(unsigned int i = 0; i < 2*windowRadius+1; i++) {
 		for(unsigned int j = 0; j < 2*windowRadius+1; j++) {
@@ -359,12 +1155,13 @@ void createPixelWindow(Pixel** PixelWindow, Image *synthesized , unsigned int wi
 			int x_coord_pixel = centerPix_x_coord - windowRadius + j;
 
 			// checks if the pixel is in bound
-			if( (y_coord_pixel >= 0 && y_coord_pixel < (int)height) && (x_coord_pixel >= 0 && x_coord_pixel < (int)width) ) {
+			if( (y_coord_pixel >= 0 && y_coord_pixel < height) && (x_coord_pixel >= 0 && x_coord_pixel < width) ) {
 				
-				PixelWindow[i*(2*windowRadius+1) + j] = &synthesized->pixels[y_coord_pixel * synWidth + x_coord_pixel];
+				PixelWindow[i*(2*windowRadius+1) + j] = &image->pixels[y_coord_pixel * width + x_coord_pixel];
 				
 				// if a pixel is unset, we change the pointer in the PixelWindow to a NULL pointer
-				if (PixelWindow[i*(2*windowRadius+1) + j]->a == 0){
+				PixelIndex idx = { x_coord_pixel, y_coord_pixel };
+				if (set != NULL && !IsBitSet(set, idx)){
 					PixelWindow[i*(2*windowRadius+1) + j] = NULL;
 				}
 
@@ -383,42 +1180,64 @@ void createPixelWindow(Pixel** PixelWindow, Image *synthesized , unsigned int wi
 
 
 
-// Takes in a double pointer to the window around the TBS pixel,
-// a double pointer to the window around the exemplar pixel, and
-// the window radius. Finds and returns the gaussian values of 
-// the exemplar pixel at the center of its window
-double findGaussScore(Pixel** tbsPixelWindow, Pixel** expPixelWindow, int windowRadius){
-	double diff = 0.0;
+// Computes the fixed-point Gaussian weights of a window with the given radius.
+// Each weight is exp(-d^2 / (2 sigma^2)) scaled by 2^GAUSS_WEIGHT_BITS and rounded,
+// so that the scores can be accumulated exactly in integer arithmetic.
+// Returns a dynamically allocated array of (2*windowRadius+1)^2 weights (NULL on failure).
+unsigned int *createGaussWeights(unsigned int windowRadius) {
+	int windowSize = 2*windowRadius + 1;
+	unsigned int *weights = malloc(sizeof(unsigned int) * windowSize * windowSize);
+	if (weights == NULL) {
+		fprintf( stderr , "[ERROR] Failed to allocate Gaussian weights: %d\n" , windowSize );
+		return NULL;
+	}
 
 	// setting sigma for Gaussian stdev as in instructions
-	double sigma = (2*windowRadius + 1) / 6.4;
+	double sigma = windowSize / 6.4;
 	double twoSigmaSquared = 2 * sigma * sigma;
-	
-	// computing Gaussian difference 
-	for(int h = 0; h < 2*windowRadius + 1; h++) {
-		for(int k = 0; k < 2*windowRadius + 1; k++) { 
-
-			Pixel* p_tbsPix = tbsPixelWindow[h*(2*windowRadius+1) + k];
-			Pixel* p_expPix = expPixelWindow[h*(2*windowRadius+1) + k];
-
-			if(p_tbsPix != NULL && p_expPix != NULL) {
 
-				Pixel tbsPix = *p_tbsPix;
-				Pixel expPix = *p_expPix;
-
-				// checks if both pixels are set; BTW the windows being checked have already been stratified such that
-				// their only being checked if they all have the same set of pixels
-				// TODO: deleted if statement that checks if both are set because isnt that what line 414 already checks?
+	for(int h = 0; h < windowSize; h++) {
+		for(int k = 0; k < windowSize; k++) {
+			int rowOffset = h - (int)windowRadius;
+			int colOffset = k - (int)windowRadius;
+			double s = exp(-1 * (colOffset * colOffset + rowOffset * rowOffset) / (twoSigmaSquared));
+			weights[h*windowSize + k] = (unsigned int)floor(s * (1 << GAUSS_WEIGHT_BITS) + 0.5);
+		}
+	}
 
-				int rowOffset = h - windowRadius;
-				int colOffset = k - windowRadius;
-				double s = exp(-1 * (colOffset * colOffset + rowOffset * rowOffset) / (twoSigmaSquared));
-				double d = PixelSquaredDifference(tbsPix, expPix);
-				
+	return weights;
+}
 
-				diff += (d * s);
-			}
-				
+// Takes in the query built from the window around the TBS pixel,
+// a pointer to the exemplar pixel in the packed exemplar and the
+// number of channels. Finds and returns the gaussian values of the
+// exemplar pixel at the center of its window (in units of
+// 2^-GAUSS_WEIGHT_BITS). The loops are specialized on the channel
+// count so grayscale exemplars only compare one value per tap.
+unsigned long long findGaussScore(const WindowQuery *query, const unsigned char *candidate, unsigned int channels){
+	unsigned long long diff = 0;
+	
+	// computing Gaussian difference 
+	if (query->paletteDistances != NULL) {
+		// palette indices: one byte per tap and a single table lookup for the color difference
+		for(unsigned int t = 0; t < query->numTaps; t++) {
+			const unsigned int *row = query->paletteDistances + query->values[t]*query->paletteSize;
+			diff += (unsigned long long)row[candidate[query->offsets[t]]] * query->weights[t];
+		}
+	}
+	else if (channels == 1) {
+		for(unsigned int t = 0; t < query->numTaps; t++) {
+			int d = (int)query->values[t] - (int)candidate[query->offsets[t]];
+			diff += (unsigned long long)(d*d) * query->weights[t];
+		}
+	}
+	else {
+		for(unsigned int t = 0; t < query->numTaps; t++) {
+			const unsigned char *c = candidate + query->offsets[t];
+			int dr = (int)query->values[3*t+0] - (int)c[0];
+			int dg = (int)query->values[3*t+1] - (int)c[1];
+			int db = (int)query->values[3*t+2] - (int)c[2];
+			diff += (unsigned long long)(dr*dr + dg*dg + db*db) * query->weights[t];
 		}
 	}
 	
@@ -432,30 +1251,31 @@ double findGaussScore(Pixel** tbsPixelWindow, Pixel** expPixelWindow, int window
 EXPPixel findBestExemplarPix(EXPPixel* EXPPixelArr, int size) {
 
 	// Finding the minimum Gaussian value in the array
-	double minValue = EXPPixelArr->GaussScore;
+	unsigned long long minValue = EXPPixelArr->GaussScore;
 
 	for(int i = 0; i < size; i++) {
-		double currentGauss = EXPPixelArr[i].GaussScore;
+		unsigned long long currentGauss = EXPPixelArr[i].GaussScore;
 		if(currentGauss <= minValue) {
 			minValue = currentGauss;
 		}
 	}
 
 	// Create array with the indices of pixels in the range
-	double adjMin = 1.1 * minValue;
+	// (score <= 1.1 * min, tested exactly as 10 * score <= 11 * min)
+	unsigned long long adjMin = 11 * minValue;
 
 	int indicesInRange[size];
 	int counter = 0;
 
 	for(int i = 0; i < size; i++) {
-		if(EXPPixelArr[i].GaussScore <= adjMin) {
+		if(10 * EXPPixelArr[i].GaussScore <= adjMin) {
 			indicesInRange[counter] = i;
 			counter++;
 		}
 	}
 
 	// Random value
-	int randomIndex = rand() % counter;
+	int randomIndex = SynthesisRandom() % counter;
 
 	return EXPPixelArr[indicesInRange[randomIndex]];
 
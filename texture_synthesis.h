@@ -1,6 +1,16 @@
 #ifndef TEXTURE_SYNTHESIS_INCLUDED
 #define TEXTURE_SYNTHESIS_INCLUDED
 #include "image.h"
+#include "bitmap.h"
+
+/** The number of fractional bits of the fixed-point Gaussian weights*/
+#define GAUSS_WEIGHT_BITS 16
+
+/** The maximum number of colors in the palette of a palette-quantized exemplar*/
+#define MAX_PALETTE_SIZE 256
+
+/** The approximate number of exemplar bytes matched against all the queries of a batch at a time (chosen to stay in L2 cache)*/
+#define MATCH_TILE_BYTES (1<<17)
 
 /** A struct storing information about a to-be-synthesized pixel*/
 typedef struct
@@ -24,48 +34,201 @@ typedef struct
 	// index of exemplar pixel
 	PixelIndex idx;
 
-	// gaussian value (as calculated)
-	double GaussScore;
+	// gaussian value (as calculated, in fixed point)
+	unsigned long long GaussScore;
 
 } EXPPixel;
 
+/** A struct storing an exemplar in the packed layout used for matching*/
+typedef struct
+{
+	/** The width of the exemplar*/
+	unsigned int width;
+
+	/** The height of the exemplar*/
+	unsigned int height;
+
+	/** The number of channels stored per pixel (1 for grayscale or palette indices, 3 for color)*/
+	unsigned int channels;
+
+	/** The channel values (or palette indices), laid out row-by-row and, within each row, column-by-column*/
+	unsigned char *values;
+
+	/** The colors of the palette (or NULL if the values are the colors themselves)*/
+	Pixel *palette;
+
+	/** The number of colors in the palette*/
+	unsigned int paletteSize;
+
+	/** The squared color differences between all pairs of palette colors, paletteSize x paletteSize*/
+	unsigned int *paletteDistances;
+
+	/** A hash table (with colorTableSize slots, a power of two) mapping every exemplar and palette color to its palette index -- a key is 0 for an empty slot and otherwise the color as 0x01RRGGBB*/
+	unsigned int colorTableSize;
+	unsigned int *colorKeys;
+	unsigned char *colorIndices;
+
+} PackedExemplar;
+
+/** A struct storing the set pixels in the window around a to-be-set pixel, packed for scoring against the exemplar*/
+typedef struct
+{
+	/** The number of set pixels (taps) in the window*/
+	unsigned int numTaps;
+
+	/** The offset of each tap from the window center in the packed exemplar's values*/
+	int *offsets;
+
+	/** The fixed-point Gaussian weight of each tap*/
+	unsigned int *weights;
+
+	/** The channel values (or palette indices) of each tap*/
+	unsigned char *values;
+
+	/** The palette distance table the palette indices are scored with (or NULL if the values are colors)*/
+	const unsigned int *paletteDistances;
+
+	/** The number of colors in the palette*/
+	unsigned int paletteSize;
+
+	/** The extent of the taps relative to the window center*/
+	int minRow , maxRow , minCol , maxCol;
+
+} WindowQuery;
+
+/** A struct storing the optional settings of a synthesis run*/
+typedef struct
+{
+	/** The file that checkpoints are periodically written to (or NULL if checkpointing is disabled)*/
+	const char *checkpointPath;
+
+	/** The number of pixels synthesized between consecutive checkpoints*/
+	unsigned int checkpointInterval;
+
+	/** The maximum number of frontier pixels with disjoint windows that are matched together in one pass over the exemplar (1 reproduces the sequential growth order exactly)*/
+	unsigned int batchSize;
+
+	/** The number of exemplar pixels sampled per synthesized pixel, in addition to those continuing the neighbors' sources (0 searches the whole exemplar)*/
+	unsigned int candidateBudget;
+
+	/** Whether the exemplar is quantized to a palette of at most MAX_PALETTE_SIZE colors and matched through a table of palette distances (exact if it has no more colors than that)*/
+	bool palette;
+
+	/** The number of rows and columns of the grid of exemplar crops scattered over the output as additional seeds, each growing its own front (1 only copies the exemplar into the top-left corner)*/
+	unsigned int seedGrid;
+
+	/** The exemplar already packed for matching (or NULL to pack it at the start of the synthesis) -- used to reuse the packing across syntheses from the same exemplar*/
+	const PackedExemplar *packedExemplar;
+
+	/** A function called with the number of leading rows of the image whose pixels are all set, whenever that number grows (or NULL) -- the completed rows are not modified afterwards*/
+	void (*rowsCompleted)( const Image *synthesized , unsigned int numRows , void *data );
+
+	/** The data passed on to rowsCompleted*/
+	void *rowsCompletedData;
+
+} SynthesisOptions;
+
+/** A function that fills in the default synthesis options (no checkpointing, no row notifications)*/
+void DefaultSynthesisOptions( SynthesisOptions *options );
+
+/** A function that seeds the random number generator used by the synthesis*/
+void SeedSynthesisRandom( unsigned int seed );
+
+/** A function that returns the next value in [0,RAND_MAX] of the synthesis random number generator*/
+int SynthesisRandom( void );
+
+/** A function that returns the full state of the synthesis random number generator (used for checkpointing)*/
+unsigned long long GetSynthesisRandomState( void );
+
+/** A function that restores a state previously returned by GetSynthesisRandomState*/
+void SetSynthesisRandomState( unsigned long long state );
+
 /** A function that compares two TBSPixels and returns a negative number if the first should come earlier in the sort order and a positive number if it should come later*/
 int CompareTBSPixels( const void *v1 , const void *v2 );
 
 /** A function that sorts an array of TBSPixels*/
 int SortTBSPixels( TBSPixel *tbsPixels , unsigned int sz );
 
+/** A function that checks that a window of the given radius fits inside the exemplar, which every synthesis requires, printing an error if it does not*/
+bool windowFitsExemplar( const Image *exemplar , unsigned int windowRadius );
+
 /** A function that extends the exemplar into an image with the specified dimensions, using the prescribed window radius -- the verbose argument is passed in to enable logging to the command prompt, if desired*/
 Image *SynthesizeFromExemplar( const Image *exemplar , unsigned int outWidth , unsigned int outHeight , unsigned int windowRadius , bool verbose );
 
-/** A helper function that changes color of pixels from old color to new color */
-void setPixel(Pixel * old_color, const Pixel new_color);
+/** A function that extends the exemplar as SynthesizeFromExemplar does, using the prescribed options (e.g. to write checkpoints)*/
+Image *SynthesizeFromExemplarWithOptions( const Image *exemplar , unsigned int outWidth , unsigned int outHeight , unsigned int windowRadius ,
+						const SynthesisOptions *options , bool verbose );
+
+/** A function that extends the exemplar as SynthesizeFromExemplarWithOptions does, writing into an image allocated by the caller whose dimensions give the output dimensions (returns -1 if the window does not fit inside the exemplar, the output is smaller than the exemplar or the synthesis fails, and 0 otherwise)*/
+int SynthesizeIntoImage( const Image *exemplar , Image *synthesized , unsigned int windowRadius ,
+						const SynthesisOptions *options , bool verbose );
+
+/** A function that continues a synthesis from a checkpoint file, producing the same image the uninterrupted run would have (returns NULL if the checkpoint cannot be read or does not match the exemplar and window radius)*/
+Image *ResumeSynthesisFromCheckpoint( const char *checkpointPath , const Image *exemplar , unsigned int windowRadius ,
+						const SynthesisOptions *options , bool verbose );
+
+/** A function that returns a copy of an existing synthesized image in which only the pixels selected by the mask (those whose red, green or blue value exceeds 127) are resynthesized from the exemplar, using the surrounding pixels as context (returns NULL if the mask does not match the image, or if it selects every pixel)*/
+Image *ResynthesizeRegion( const Image *exemplar , const Image *existing , const Image *mask , unsigned int windowRadius ,
+						const SynthesisOptions *options , bool verbose );
+
+/** A helper function that changes the color of an unset pixel to the new color and marks it as set */
+void setPixel(Image *synthesized, Bitmap *set, PixelIndex idx, const Pixel new_color);
+
+/** A helper function that finds all TBS Pixels (unset pixels with at least one set neighbor) inside the region [regionMin,regionMax) */
+TBSPixel *findTBSPixel(const Bitmap *set, PixelIndex regionMin, PixelIndex regionMax, int* size);
+
+/** A helper function that copies a random crop of the exemplar into the middle of each cell of a grid x grid partition of the image that does not overlap the top-left exemplar copy, marking the pixels as set and recording their sources*/
+void placeSeedPatches(Image *synthesized, Bitmap *set, PixelIndex *sources, const Image *exemplar,
+						unsigned int windowRadius, unsigned int grid);
+
+/** A helper function that allocates the array of exemplar sources of an image's pixels, with every source unknown (INVALID_PIXEL_COORD)*/
+PixelIndex *createSourceMap(unsigned int width, unsigned int height);
+
+/** A function that synthesizes all unset Pixels in the given image from the exemplar, marking them in the bitmap of set pixels and recording the exemplar pixel they were copied from as it goes */
+void synthesizeTexture(Image *synthesized , Bitmap *set , PixelIndex *sources , const Image *exemplar , unsigned int windowRadius, const SynthesisOptions *options);
+
+/** A helper function to set the values of the first numPixels to-be-set pixels, whose windows have to be disjoint, in a single pass over the packed exemplar (or over a sample of it, if candidateBudget is not 0), copying the matched pixels from the source exemplar image*/
+void synthesizePixels(TBSPixel* TBSPixelArr, unsigned int numPixels, Image *synthesized , Bitmap *set , PixelIndex *sources , const Image *source ,
+						const PackedExemplar *exemplar , const unsigned int *weights, unsigned int windowRadius, unsigned int candidateBudget);
+
+/** A helper function that scores the given coherent candidates and a stratified random sample of budget valid candidates of a query (all valid candidates if there are no more than budget), returning the number of candidates stored*/
+int scoreWindowQuerySampled(const WindowQuery *query, const PackedExemplar *exemplar, const PixelIndex *coherent,
+						unsigned int numCoherent, unsigned int budget, EXPPixel *EXPPixelArr);
+
+/** A helper function that scores every valid exemplar candidate of several queries, tile by tile, storing the candidates of each query in row-major order*/
+void scoreWindowQueries(const WindowQuery *queries, unsigned int numQueries, const PackedExemplar *exemplar,
+						EXPPixel **EXPPixelArrs, int *counters);
+
+/** A helper function that moves up to maxPixels pixels of a sorted TBSPixel array whose windows are pairwise disjoint to the front of the array (starting with the first pixel) and returns their number*/
+unsigned int selectIndependentTBSPixels(TBSPixel *TBSPixelArr, unsigned int size, unsigned int maxPixels, unsigned int windowRadius);
+
+/** A helper function that packs the set pixels of a TBS pixel window into a query against the packed exemplar (the query's arrays must be large enough for a full window)*/
+void createWindowQuery(WindowQuery *query, const Pixel** PixelWindow, const unsigned int *weights,
+						unsigned int windowRadius, const PackedExemplar *exemplar);
 
-/** A helper function that checks if the inputted index is in bound */
-int checkIndexInBound(int index, unsigned int Width, unsigned int Height);
+/** A function that packs an exemplar into the matching layout (one byte per pixel if it is grayscale, three otherwise), returning NULL on failure*/
+PackedExemplar *PackExemplar(const Image *exemplar);
 
-/** A helper function that finds the number of set, existing neigboring pixels */
-int findNumNeigbhors(Image *synthesized, int index, unsigned int Width, unsigned int Height);
+/** A function that packs an exemplar as one palette index per pixel, quantizing it by median cut if it has more than MAX_PALETTE_SIZE colors, returning NULL on failure*/
+PackedExemplar *PackExemplarWithPalette(const Image *exemplar);
 
-/** A helper function that finds all TBS Pixels */
-TBSPixel *findTBSPixel(Image *synthesized, unsigned int Width , unsigned int Height, int* size);
+/** A function that returns the index of the palette color of a packed exemplar closest to the given color*/
+unsigned char findPaletteIndex(const PackedExemplar *exemplar, Pixel color);
 
-/** A function that synthesizes all Pixels in the given image */
-void synthesizeTexture(Image *synthesized , unsigned int exWidth , unsigned int exHeight , 
-						unsigned int synWidth, unsigned int synHeight, unsigned int windowRadius);
+/** A function that frees a packed exemplar and sets the pointer to NULL*/
+void FreePackedExemplar(PackedExemplar **packed);
 
-/** A helper function to set the value of the to-be-set pixel with the greatest amount of neighbors*/
-void synthesizePixel(TBSPixel* TBSPixelArr, Image *synthesized , unsigned int exWidth , unsigned int exHeight , 
-						unsigned int synWidth, unsigned int synHeight, unsigned int windowRadius);
+/** A helper function that computes the fixed-point Gaussian weights of a window (scaled by 2^GAUSS_WEIGHT_BITS), returning a dynamically allocated array*/
+unsigned int *createGaussWeights(unsigned int windowRadius);
 
-/** A helper function to compute the Gaussian difference of a expPixelWindow compared to a tbsPixelWindow*/
-double findGaussScore(Pixel** tbsPixelWindow, Pixel** expPixelWindow, int radius);
+/** A helper function to compute the Gaussian difference of the exemplar window centered at candidate compared to the query, using integer arithmetic only*/
+unsigned long long findGaussScore(const WindowQuery *query, const unsigned char *candidate, unsigned int channels);
 
 /** A function that finds the pixel with the lowest Gaussian value in an array of exemplar pixels */
 EXPPixel findBestExemplarPix(EXPPixel* EXPPixelArr, int size);
 
-/** function that takes a pixel window and assigns the pixel values around the center of the window */
-void createPixelWindow(Pixel** PixelWindow, Image *synthesized , unsigned int width , unsigned int height, unsigned int synWidth,
-						 unsigned int windowRadius, int centerPix_y_coord, int centerPix_x_coord);
+/** function that takes a pixel window and assigns the pixels of the image around the center of the window (NULL for pixels that are out of bounds or unset according to the bitmap, if one is given) */
+void createPixelWindow(const Pixel** PixelWindow, const Image *image , const Bitmap *set , unsigned int windowRadius,
+						 int centerPix_y_coord, int centerPix_x_coord);
 
 #endif // TEXTURE_SYNTHESIS_INCLUDED
\ No newline at end of file